@@ -0,0 +1,446 @@
+/*
+ * apex_bpred.c
+ * Contains the branch predictors and the branch target buffer consulted
+ * by the fetch stage
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_bpred.h"
+#include "apex_macros.h"
+
+/* Instructions are 4 bytes apart, drop the bits that never change */
+#define PC_KEY(pc) ((unsigned int)(pc) >> 2)
+#define LOW_BITS(bits) ((1ULL << (bits)) - 1) /* bits below 64 */
+
+/* History lengths of the TAGE tables, each about twice the last */
+static const int tage_lengths[TAGE_TABLES] = {5, 11, 22, 44};
+
+/* Saturating 2-bit counters, taken from 2 up */
+static void
+train_counter(unsigned char *ctr, int taken)
+{
+    if (taken && *ctr < 3)
+    {
+        (*ctr)++;
+    }
+    else if (!taken && *ctr > 0)
+    {
+        (*ctr)--;
+    }
+}
+
+static int
+static_predict(APEX_Bpred *bp, int pc, unsigned long long hist)
+{
+    (void)bp;
+    (void)pc;
+    (void)hist;
+    return FALSE;
+}
+
+static void
+static_update(APEX_Bpred *bp, int pc, unsigned long long hist, int taken)
+{
+    (void)bp;
+    (void)pc;
+    (void)hist;
+    (void)taken;
+}
+
+static int
+bimodal_predict(APEX_Bpred *bp, int pc, unsigned long long hist)
+{
+    (void)hist;
+    return bp->counters[PC_KEY(pc) & LOW_BITS(bp->table_bits)] >= 2;
+}
+
+static void
+bimodal_update(APEX_Bpred *bp, int pc, unsigned long long hist, int taken)
+{
+    (void)hist;
+    train_counter(&bp->counters[PC_KEY(pc) & LOW_BITS(bp->table_bits)], taken);
+}
+
+static unsigned int
+gshare_index(const APEX_Bpred *bp, int pc, unsigned long long hist)
+{
+    return (PC_KEY(pc) ^ (hist & LOW_BITS(bp->hist_bits))) & LOW_BITS(bp->table_bits);
+}
+
+static int
+gshare_predict(APEX_Bpred *bp, int pc, unsigned long long hist)
+{
+    return bp->counters[gshare_index(bp, pc, hist)] >= 2;
+}
+
+static void
+gshare_update(APEX_Bpred *bp, int pc, unsigned long long hist, int taken)
+{
+    train_counter(&bp->counters[gshare_index(bp, pc, hist)], taken);
+}
+
+/* XORs the newest length bits of the history down to bits bits */
+static unsigned int
+fold_history(unsigned long long hist, int length, int bits)
+{
+    unsigned long long h = hist & LOW_BITS(length);
+    unsigned int folded = 0;
+
+    while (h)
+    {
+        folded ^= h & LOW_BITS(bits);
+        h >>= bits;
+    }
+    return folded;
+}
+
+static unsigned int
+tage_index(const APEX_Bpred *bp, int table, int pc, unsigned long long hist)
+{
+    unsigned int key = PC_KEY(pc);
+
+    return (key ^ (key >> bp->tage_bits) ^ fold_history(hist, tage_lengths[table], bp->tage_bits) ^
+            (table * 0x9e5)) &
+           LOW_BITS(bp->tage_bits);
+}
+
+static unsigned char
+tage_tag(int table, int pc, unsigned long long hist)
+{
+    return (PC_KEY(pc) ^ (fold_history(hist, tage_lengths[table], TAGE_TAG_BITS - 1) << 1)) &
+           LOW_BITS(TAGE_TAG_BITS);
+}
+
+/*
+ * Finds the longest-history table whose entry matches (the provider) and
+ * the next one below it (the alternate), -1 standing for the base table.
+ * Recomputed at update from the history the branch was predicted with,
+ * so fetch does not have to carry the indices along.
+ */
+static void
+tage_lookup(const APEX_Bpred *bp, int pc, unsigned long long hist, int *provider, int *alt)
+{
+    *provider = -1;
+    *alt = -1;
+    for (int t = TAGE_TABLES - 1; t >= 0; --t)
+    {
+        if (bp->tage[t][tage_index(bp, t, pc, hist)].tag == tage_tag(t, pc, hist))
+        {
+            if (*provider < 0)
+            {
+                *provider = t;
+            }
+            else
+            {
+                *alt = t;
+                break;
+            }
+        }
+    }
+}
+
+static int
+tage_table_predict(const APEX_Bpred *bp, int table, int pc, unsigned long long hist)
+{
+    if (table < 0)
+    {
+        return bp->counters[PC_KEY(pc) & LOW_BITS(bp->table_bits)] >= 2;
+    }
+    return bp->tage[table][tage_index(bp, table, pc, hist)].ctr >= 4;
+}
+
+static int
+tage_predict(APEX_Bpred *bp, int pc, unsigned long long hist)
+{
+    int provider, alt;
+
+    tage_lookup(bp, pc, hist, &provider, &alt);
+    return tage_table_predict(bp, provider, pc, hist);
+}
+
+static void
+tage_update(APEX_Bpred *bp, int pc, unsigned long long hist, int taken)
+{
+    int provider, alt;
+    int predicted;
+
+    tage_lookup(bp, pc, hist, &provider, &alt);
+    predicted = tage_table_predict(bp, provider, pc, hist);
+    if (provider < 0)
+    {
+        bimodal_update(bp, pc, hist, taken);
+    }
+    else
+    {
+        TAGE_ENTRY *entry = &bp->tage[provider][tage_index(bp, provider, pc, hist)];
+
+        if (predicted != tage_table_predict(bp, alt, pc, hist))
+        {
+            if (predicted == taken && entry->useful < 3)
+            {
+                entry->useful++;
+            }
+            else if (predicted != taken && entry->useful > 0)
+            {
+                entry->useful--;
+            }
+        }
+        if (taken && entry->ctr < 7)
+        {
+            entry->ctr++;
+        }
+        else if (!taken && entry->ctr > 0)
+        {
+            entry->ctr--;
+        }
+    }
+
+    /* A miss claims an entry in a longer table, or ages the candidates so
+     * one frees up for the next miss */
+    if (predicted != taken && provider < TAGE_TABLES - 1)
+    {
+        int allocated = FALSE;
+
+        for (int t = provider + 1; t < TAGE_TABLES && !allocated; ++t)
+        {
+            TAGE_ENTRY *entry = &bp->tage[t][tage_index(bp, t, pc, hist)];
+
+            if (entry->useful == 0)
+            {
+                entry->tag = tage_tag(t, pc, hist);
+                entry->ctr = taken ? 4 : 3;
+                allocated = TRUE;
+            }
+        }
+        for (int t = provider + 1; t < TAGE_TABLES && !allocated; ++t)
+        {
+            bp->tage[t][tage_index(bp, t, pc, hist)].useful--;
+        }
+    }
+
+    if (++bp->tage_updates == TAGE_RESET_PERIOD)
+    {
+        bp->tage_updates = 0;
+        for (int t = 0; t < TAGE_TABLES; ++t)
+        {
+            for (unsigned int i = 0; i < (1U << bp->tage_bits); ++i)
+            {
+                bp->tage[t][i].useful >>= 1;
+            }
+        }
+    }
+}
+
+#define APEX_BPRED_NAME(name, option, uses_btb) option,
+static const char *const bpred_names[NUM_BPREDS] = {APEX_BPRED_TABLE(APEX_BPRED_NAME)};
+
+#define APEX_BPRED_BTB(name, option, uses_btb) uses_btb,
+static const int bpred_uses_btb[NUM_BPREDS] = {APEX_BPRED_TABLE(APEX_BPRED_BTB)};
+
+/*
+ * Creates the predictor named by an option value with 2^table_bits
+ * direction counters, hist_bits (1 to 63) of global history for gshare, a
+ * 2^btb_bits entry direct-mapped BTB and a ras_depth entry return address
+ * stack. Returns NULL for an unknown name, a size out of range or when
+ * its tables cannot be allocated.
+ */
+APEX_Bpred *
+apex_bpred_create(const char *name, int table_bits, int hist_bits, int btb_bits, int ras_depth)
+{
+    APEX_Bpred *bp;
+    int kind;
+
+    for (kind = 0; kind < NUM_BPREDS; ++kind)
+    {
+        if (strcmp(name, bpred_names[kind]) == 0)
+        {
+            break;
+        }
+    }
+    if (kind == NUM_BPREDS || table_bits < 4 || table_bits > 24 || hist_bits < 1 ||
+        hist_bits > 63 || btb_bits < 1 || btb_bits > 20 || ras_depth < 0 ||
+        ras_depth > RAS_MAX_DEPTH)
+    {
+        return NULL;
+    }
+
+    bp = calloc(1, sizeof(APEX_Bpred));
+    if (!bp)
+    {
+        return NULL;
+    }
+    bp->kind = kind;
+    bp->name = bpred_names[kind];
+    bp->uses_btb = bpred_uses_btb[kind];
+    bp->table_bits = table_bits;
+    bp->hist_bits = hist_bits;
+    bp->btb_bits = btb_bits;
+    /* The static front end never leaves the fall-through path */
+    bp->ras_depth = bp->uses_btb ? ras_depth : 0;
+    switch (kind)
+    {
+        case BP_BIMODAL:
+            bp->predict = bimodal_predict;
+            bp->update = bimodal_update;
+            break;
+
+        case BP_GSHARE:
+            bp->predict = gshare_predict;
+            bp->update = gshare_update;
+            break;
+
+        case BP_TAGE:
+            bp->predict = tage_predict;
+            bp->update = tage_update;
+            break;
+
+        default:
+            bp->predict = static_predict;
+            bp->update = static_update;
+            break;
+    }
+
+    bp->counters = malloc(1U << table_bits);
+    bp->btb = malloc((1U << btb_bits) * sizeof(BTB_ENTRY));
+    bp->ras = calloc(bp->ras_depth + 1, sizeof(int));
+    if (!bp->counters || !bp->btb || !bp->ras)
+    {
+        apex_bpred_free(bp);
+        return NULL;
+    }
+    if (kind == BP_TAGE)
+    {
+        /* The tagged tables share the budget of the base table */
+        bp->tage_bits = table_bits - 2;
+        for (int t = 0; t < TAGE_TABLES; ++t)
+        {
+            bp->tage[t] = calloc(1U << bp->tage_bits, sizeof(TAGE_ENTRY));
+            if (!bp->tage[t])
+            {
+                apex_bpred_free(bp);
+                return NULL;
+            }
+        }
+    }
+
+    /* Counters start weakly not-taken, like the static front end */
+    memset(bp->counters, 1, 1U << table_bits);
+    for (unsigned int i = 0; i < (1U << btb_bits); ++i)
+    {
+        bp->btb[i].pc = -1;
+    }
+    return bp;
+}
+
+void
+apex_bpred_free(APEX_Bpred *bp)
+{
+    if (!bp)
+    {
+        return;
+    }
+    for (int t = 0; t < TAGE_TABLES; ++t)
+    {
+        free(bp->tage[t]);
+    }
+    free(bp->counters);
+    free(bp->btb);
+    free(bp->ras);
+    free(bp);
+}
+
+int
+apex_bpred_btb_lookup(const APEX_Bpred *bp, int pc, int *target)
+{
+    const BTB_ENTRY *entry = &bp->btb[PC_KEY(pc) & LOW_BITS(bp->btb_bits)];
+
+    if (entry->pc != pc)
+    {
+        return FALSE;
+    }
+    *target = entry->target;
+    return TRUE;
+}
+
+void
+apex_bpred_btb_update(APEX_Bpred *bp, int pc, int target)
+{
+    BTB_ENTRY *entry = &bp->btb[PC_KEY(pc) & LOW_BITS(bp->btb_bits)];
+
+    entry->pc = pc;
+    entry->target = target;
+}
+
+/* Fetch shifts in each conditional branch's predicted direction */
+void
+apex_bpred_push_history(APEX_Bpred *bp, int taken)
+{
+    bp->hist = (bp->hist << 1) | (taken != 0);
+}
+
+/*
+ * Puts the history back to what it was after a mispredicted branch,
+ * hist being the value the branch was fetched with: the outcomes fetch
+ * guessed past it belong to squashed instructions.
+ */
+void
+apex_bpred_recover(APEX_Bpred *bp, unsigned long long hist, int conditional, int taken)
+{
+    bp->hist = conditional ? (hist << 1) | (taken != 0) : hist;
+}
+
+/* Fetch pushes the address after each JAL */
+void
+apex_bpred_ras_push(APEX_Bpred *bp, int return_pc)
+{
+    if (bp->ras_depth == 0)
+    {
+        return;
+    }
+    bp->ras[bp->ras_top] = return_pc;
+    bp->ras_top = (bp->ras_top + 1) % bp->ras_depth;
+    if (bp->ras_count < bp->ras_depth)
+    {
+        bp->ras_count++;
+    }
+}
+
+/* and takes a JUMP to be the return of the latest one; with nothing on the
+ * stack the JUMP is left to the BTB */
+int
+apex_bpred_ras_pop(APEX_Bpred *bp, int *target)
+{
+    if (bp->ras_count == 0)
+    {
+        return FALSE;
+    }
+    bp->ras_top = (bp->ras_top + bp->ras_depth - 1) % bp->ras_depth;
+    bp->ras_count--;
+    *target = bp->ras[bp->ras_top];
+    return TRUE;
+}
+
+void
+apex_bpred_ras_save(const APEX_Bpred *bp, RAS_SNAPSHOT *snapshot)
+{
+    snapshot->top = bp->ras_top;
+    snapshot->count = bp->ras_count;
+    snapshot->tos = bp->ras_depth ? bp->ras[(bp->ras_top + bp->ras_depth - 1) % bp->ras_depth] : 0;
+}
+
+void
+apex_bpred_ras_restore(APEX_Bpred *bp, const RAS_SNAPSHOT *snapshot)
+{
+    if (bp->ras_depth == 0)
+    {
+        return;
+    }
+    bp->ras_top = snapshot->top;
+    bp->ras_count = snapshot->count;
+    bp->ras[(bp->ras_top + bp->ras_depth - 1) % bp->ras_depth] = snapshot->tos;
+}
@@ -0,0 +1,100 @@
+/*
+ * apex_bpred.h
+ * Contains the branch predictors and the branch target buffer consulted
+ * by the fetch stage
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_BPRED_H_
+#define _APEX_BPRED_H_
+
+/* Default predictor and sizes, log2 of the entries; all can be changed
+ * with options */
+#define APEX_BPRED_DEFAULT "static"
+#define BP_TABLE_BITS 12
+#define BP_HIST_BITS 12
+#define BTB_BITS 9
+#define RAS_DEPTH 8
+#define RAS_MAX_DEPTH 1024
+
+/* TAGE-like predictor: a bimodal base and tagged tables indexed with
+ * geometrically longer global histories */
+#define TAGE_TABLES 4
+#define TAGE_TAG_BITS 8
+#define TAGE_RESET_PERIOD (1 << 18) /* updates between useful-bit decays */
+
+/* Predictor kinds, X(name, option, uses_btb); the static predictor is the
+ * original front end, it always falls through */
+#define APEX_BPRED_TABLE(X)         \
+    X(STATIC, "static", 0)          \
+    X(BIMODAL, "bimodal", 1)        \
+    X(GSHARE, "gshare", 1)          \
+    X(TAGE, "tage", 1)
+
+#define APEX_BPRED_ENUM(name, option, uses_btb) BP_##name,
+enum
+{
+    APEX_BPRED_TABLE(APEX_BPRED_ENUM)
+    NUM_BPREDS
+};
+
+typedef struct BTB_ENTRY
+{
+    int pc; /* branch the entry belongs to, -1 when empty */
+    int target;
+} BTB_ENTRY;
+
+/* What a branch needs to put the return address stack back: the top as
+ * fetch found it and the entry under it, the one a wrong-path pop and push
+ * would overwrite */
+typedef struct RAS_SNAPSHOT
+{
+    int top;
+    int count;
+    int tos;
+} RAS_SNAPSHOT;
+
+typedef struct TAGE_ENTRY
+{
+    unsigned char ctr;    /* 3-bit counter, taken from 4 up */
+    unsigned char tag;
+    unsigned char useful; /* 2-bit */
+} TAGE_ENTRY;
+
+typedef struct APEX_Bpred
+{
+    int kind;
+    const char *name;
+    int uses_btb;
+    int (*predict)(struct APEX_Bpred *bp, int pc, unsigned long long hist);
+    void (*update)(struct APEX_Bpred *bp, int pc, unsigned long long hist, int taken);
+    int table_bits;
+    int hist_bits;
+    unsigned long long hist; /* speculative global history, newest outcome in bit 0 */
+    unsigned char *counters; /* 2-bit counters of bimodal and gshare, the TAGE base */
+    TAGE_ENTRY *tage[TAGE_TABLES];
+    int tage_bits;
+    unsigned int tage_updates;
+    BTB_ENTRY *btb;
+    int btb_bits;
+    int *ras;      /* return addresses, circular so an overflow drops the oldest */
+    int ras_depth; /* 0 when off */
+    int ras_top;   /* next free slot */
+    int ras_count; /* live entries, up to ras_depth */
+} APEX_Bpred;
+
+APEX_Bpred *apex_bpred_create(const char *name, int table_bits, int hist_bits, int btb_bits,
+                              int ras_depth);
+void apex_bpred_free(APEX_Bpred *bp);
+int apex_bpred_btb_lookup(const APEX_Bpred *bp, int pc, int *target);
+void apex_bpred_btb_update(APEX_Bpred *bp, int pc, int target);
+void apex_bpred_push_history(APEX_Bpred *bp, int taken);
+void apex_bpred_recover(APEX_Bpred *bp, unsigned long long hist, int conditional, int taken);
+void apex_bpred_ras_push(APEX_Bpred *bp, int return_pc);
+int apex_bpred_ras_pop(APEX_Bpred *bp, int *target);
+void apex_bpred_ras_save(const APEX_Bpred *bp, RAS_SNAPSHOT *snapshot);
+void apex_bpred_ras_restore(APEX_Bpred *bp, const RAS_SNAPSHOT *snapshot);
+
+#endif
@@ -0,0 +1,383 @@
+/*
+ * apex_cache.c
+ * Contains the L1 data cache model between the memory pipes and data
+ * memory
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cache.h"
+#include "apex_macros.h"
+
+/* Seed of the random policy, fixed so runs repeat */
+#define REPL_SEED 0x2545f491u
+
+#define APEX_REPL_NAME(name, option) option,
+static const char *const repl_names[NUM_REPLS] = {APEX_REPL_TABLE(APEX_REPL_NAME)};
+
+static int
+log2_exact(int n)
+{
+    int bits = 0;
+
+    if (n < 1 || (n & (n - 1)))
+    {
+        return -1;
+    }
+    while ((1 << bits) < n)
+    {
+        bits++;
+    }
+    return bits;
+}
+
+/* The way of row holding tag, -1 if none */
+static int
+find_way(const APEX_Cache *cache, const unsigned int *row, unsigned int tag)
+{
+    for (int way = 0; way < cache->assoc; way++)
+    {
+        if (row[way] == tag)
+        {
+            return way;
+        }
+    }
+    return -1;
+}
+
+/* Heap-ordered tree, node 1 at the root: a set bit sends the victim search
+ * to the right. A use points every node on the way's path away from it. */
+static void
+plru_touch(APEX_Cache *cache, int set, int way)
+{
+    unsigned int *bits = &cache->plru[set];
+    int levels = log2_exact(cache->assoc);
+    int node = 1;
+
+    for (int b = levels - 1; b >= 0; b--)
+    {
+        int right = (way >> b) & 1;
+
+        if (right)
+        {
+            *bits &= ~(1u << node);
+        }
+        else
+        {
+            *bits |= 1u << node;
+        }
+        node = node * 2 + right;
+    }
+}
+
+static int
+plru_victim(const APEX_Cache *cache, int set)
+{
+    unsigned int bits = cache->plru[set];
+    int levels = log2_exact(cache->assoc);
+    int node = 1;
+    int way = 0;
+
+    for (int b = 0; b < levels; b++)
+    {
+        int right = (bits >> node) & 1;
+
+        way = way * 2 + right;
+        node = node * 2 + right;
+    }
+    return way;
+}
+
+static void
+touch(APEX_Cache *cache, int set, int way)
+{
+    switch (cache->policy)
+    {
+        case REPL_LRU:
+            cache->stamps[set * cache->assoc + way] = ++cache->clock;
+            break;
+
+        case REPL_PLRU:
+            plru_touch(cache, set, way);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* An empty way if the set has one, else the one the policy gives up */
+static int
+victim(APEX_Cache *cache, int set)
+{
+    const unsigned int *row = &cache->tags[set * cache->assoc];
+    int way = find_way(cache, row, 0);
+
+    if (way >= 0)
+    {
+        return way;
+    }
+    switch (cache->policy)
+    {
+        case REPL_LRU:
+        {
+            const unsigned int *stamps = &cache->stamps[set * cache->assoc];
+
+            way = 0;
+            for (int w = 1; w < cache->assoc; w++)
+            {
+                if (stamps[w] < stamps[way])
+                {
+                    way = w;
+                }
+            }
+            return way;
+        }
+
+        case REPL_PLRU:
+            return plru_victim(cache, set);
+
+        default:
+            cache->rng ^= cache->rng << 13;
+            cache->rng ^= cache->rng >> 17;
+            cache->rng ^= cache->rng << 5;
+            return cache->rng % cache->assoc;
+    }
+}
+
+/* A line a prefetch brought in is counted once, by the first access that
+ * wants it, whether the fill has arrived or not */
+static void
+clear_prefetch(APEX_Cache *cache, unsigned int tag)
+{
+    int set = (tag - 1) & (cache->sets - 1);
+    int way = find_way(cache, &cache->tags[set * cache->assoc], tag);
+
+    if (way >= 0)
+    {
+        cache->prefetched[set * cache->assoc + way] = FALSE;
+    }
+    for (int i = 0; i < cache->num_mshrs; i++)
+    {
+        if (cache->mshr[i].line == tag)
+        {
+            cache->mshr[i].prefetch = FALSE;
+        }
+    }
+}
+
+/* Puts the line of tag in its set, marked as prefetched if prefetch, or
+ * marks it used if it is there. Returns L1D_HIT, L1D_PREFETCH_HIT or
+ * L1D_MISS */
+static int
+lookup(APEX_Cache *cache, unsigned int tag, int prefetch)
+{
+    int set = (tag - 1) & (cache->sets - 1);
+    unsigned int *row = &cache->tags[set * cache->assoc];
+    int way = find_way(cache, row, tag);
+    int outcome = L1D_HIT;
+
+    if (way < 0)
+    {
+        way = victim(cache, set);
+        row[way] = tag;
+        cache->prefetched[set * cache->assoc + way] = prefetch;
+        outcome = L1D_MISS;
+    }
+    else if (cache->prefetched[set * cache->assoc + way])
+    {
+        clear_prefetch(cache, tag);
+        outcome = L1D_PREFETCH_HIT;
+    }
+    touch(cache, set, way);
+    return outcome;
+}
+
+/* The MSHR filling the line of tag, NULL if none; *free_mshr is set to the
+ * first one not in use, NULL if all are */
+static MSHR *
+find_mshr(APEX_Cache *cache, unsigned int tag, int now, MSHR **free_mshr)
+{
+    *free_mshr = NULL;
+    for (int i = 0; i < cache->num_mshrs; i++)
+    {
+        MSHR *mshr = &cache->mshr[i];
+
+        if (mshr->line && mshr->ready > now)
+        {
+            if (mshr->line == tag)
+            {
+                return mshr;
+            }
+        }
+        else if (!*free_mshr)
+        {
+            *free_mshr = mshr;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Creates a cache of size words in lines of line words. Size, line and the
+ * number of sets must be powers of two, and so must assoc for plru.
+ * Returns NULL for an unknown policy, a size out of range or when its
+ * arrays cannot be allocated.
+ */
+APEX_Cache *
+apex_cache_create(int size, int assoc, int line, const char *policy, int hit_latency,
+                  int miss_latency, int mshrs)
+{
+    APEX_Cache *cache;
+    int kind;
+
+    for (kind = 0; kind < NUM_REPLS; ++kind)
+    {
+        if (strcmp(policy, repl_names[kind]) == 0)
+        {
+            break;
+        }
+    }
+    if (kind == NUM_REPLS || assoc < 1 || assoc > MAX_L1D_ASSOC ||
+        (kind == REPL_PLRU && log2_exact(assoc) < 0) || log2_exact(line) < 0 ||
+        size % (assoc * line) || log2_exact(size / (assoc * line)) < 0 || hit_latency < 1 ||
+        miss_latency < 1 || mshrs < 1 || mshrs > MAX_MSHRS)
+    {
+        return NULL;
+    }
+
+    cache = calloc(1, sizeof(APEX_Cache));
+    if (!cache)
+    {
+        return NULL;
+    }
+    cache->policy = kind;
+    cache->policy_name = repl_names[kind];
+    cache->assoc = assoc;
+    cache->sets = size / (assoc * line);
+    cache->set_bits = log2_exact(cache->sets);
+    cache->line_bits = log2_exact(line);
+    cache->hit_latency = hit_latency;
+    cache->miss_latency = miss_latency;
+    cache->num_mshrs = mshrs;
+    cache->rng = REPL_SEED;
+    cache->tags = calloc(cache->sets * assoc, sizeof(unsigned int));
+    cache->stamps = calloc(cache->sets * assoc, sizeof(unsigned int));
+    cache->plru = calloc(cache->sets, sizeof(unsigned int));
+    cache->prefetched = calloc(cache->sets * assoc, 1);
+    if (!cache->tags || !cache->stamps || !cache->plru || !cache->prefetched)
+    {
+        apex_cache_free(cache);
+        return NULL;
+    }
+    snprintf(cache->name, sizeof(cache->name), "%d words, %d-way, %d-word lines, %s, %d/%d cycles, %d MSHRs",
+             size, assoc, line, cache->policy_name, hit_latency, miss_latency, mshrs);
+    return cache;
+}
+
+void
+apex_cache_free(APEX_Cache *cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+    free(cache->tags);
+    free(cache->stamps);
+    free(cache->plru);
+    free(cache->prefetched);
+    free(cache);
+}
+
+/*
+ * A load in cycle now. Sets *ready to the cycle its value arrives, now
+ * itself for a one-cycle hit, and returns the L1D_* outcome; on
+ * L1D_MSHR_FULL nothing changed and the load has to try again. A missing
+ * line is put in its set at once, the MSHR holds later loads to it until
+ * the fill arrives.
+ */
+int
+apex_cache_load(APEX_Cache *cache, int address, int now, int *ready)
+{
+    unsigned int tag = ((unsigned int)address >> cache->line_bits) + 1;
+    MSHR *free_mshr;
+    MSHR *mshr = find_mshr(cache, tag, now, &free_mshr);
+    int outcome;
+
+    if (mshr)
+    {
+        *ready = mshr->ready;
+        if (mshr->prefetch)
+        {
+            clear_prefetch(cache, tag);
+            return L1D_PREFETCH_LATE;
+        }
+        return L1D_MERGE;
+    }
+    if (find_way(cache, &cache->tags[((tag - 1) & (cache->sets - 1)) * cache->assoc], tag) < 0 &&
+        !free_mshr)
+    {
+        return L1D_MSHR_FULL;
+    }
+    *ready = now + cache->hit_latency - 1;
+    outcome = lookup(cache, tag, FALSE);
+    if (outcome == L1D_MISS)
+    {
+        *ready += cache->miss_latency;
+        free_mshr->line = tag;
+        free_mshr->ready = *ready;
+        free_mshr->prefetch = FALSE;
+    }
+    return outcome;
+}
+
+/* A store as it commits; a missing line is allocated without holding up
+ * commit, the store is taken to sit in a write buffer until it fills */
+int
+apex_cache_store(APEX_Cache *cache, int address)
+{
+    return lookup(cache, ((unsigned int)address >> cache->line_bits) + 1, FALSE);
+}
+
+/* Starts filling the line of address ahead of the loads, TRUE if it did;
+ * a line already there or on its way, or no free MSHR, drops it */
+int
+apex_cache_prefetch(APEX_Cache *cache, int address, int now)
+{
+    unsigned int tag = ((unsigned int)address >> cache->line_bits) + 1;
+    MSHR *free_mshr;
+
+    if (find_mshr(cache, tag, now, &free_mshr) || !free_mshr ||
+        find_way(cache, &cache->tags[((tag - 1) & (cache->sets - 1)) * cache->assoc], tag) >= 0)
+    {
+        return FALSE;
+    }
+    lookup(cache, tag, TRUE);
+    free_mshr->line = tag;
+    free_mshr->ready = now + cache->hit_latency - 1 + cache->miss_latency;
+    free_mshr->prefetch = TRUE;
+    return TRUE;
+}
+
+/* First cycle after now in which an MSHR frees up, -1 if none is busy */
+int
+apex_cache_next_fill(const APEX_Cache *cache, int now)
+{
+    int next = -1;
+
+    for (int i = 0; i < cache->num_mshrs; i++)
+    {
+        const MSHR *mshr = &cache->mshr[i];
+
+        if (mshr->line && mshr->ready > now && (next < 0 || mshr->ready < next))
+        {
+            next = mshr->ready;
+        }
+    }
+    return next;
+}
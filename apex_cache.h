@@ -0,0 +1,101 @@
+/*
+ * apex_cache.h
+ * Contains the L1 data cache model between the memory pipes and data
+ * memory. It holds tags only, values always come from data memory; what it
+ * decides is when a load's value is there.
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_CACHE_H_
+#define _APEX_CACHE_H_
+
+/* Defaults, sizes in data memory words; all can be changed with options.
+ * Without --l1d there is no cache and every load takes one cycle, as data
+ * memory always did */
+#define L1D_ASSOC 4
+#define L1D_LINE 8
+#define L1D_REPL_DEFAULT "lru"
+#define L1D_HIT_LATENCY 1
+#define L1D_MISS_LATENCY 20
+#define L1D_MSHRS 4
+#define MAX_MSHRS 32
+#define MAX_L1D_ASSOC 32
+
+/* Replacement policies, X(name, option); plru is a binary tree per set */
+#define APEX_REPL_TABLE(X)  \
+    X(LRU, "lru")           \
+    X(PLRU, "plru")         \
+    X(RANDOM, "random")
+
+#define APEX_REPL_ENUM(name, option) REPL_##name,
+enum
+{
+    APEX_REPL_TABLE(APEX_REPL_ENUM)
+    NUM_REPLS
+};
+
+/* What an access found, X(name, label). A merge is a miss to a line
+ * already being fetched, it waits for the same fill without an MSHR of its
+ * own; a load that finds every MSHR busy keeps trying until a fill frees
+ * one, and is counted once. The first access to a line a prefetch brought
+ * in is a prefetch hit, or late if the fill is still on its way */
+#define APEX_L1D_TABLE(X)           \
+    X(HIT, "hits")                  \
+    X(MISS, "misses")               \
+    X(MERGE, "mshr_merges")         \
+    X(MSHR_FULL, "mshr_full")       \
+    X(PREFETCH_HIT, "prefetch_hits") \
+    X(PREFETCH_LATE, "prefetch_late")
+
+#define APEX_L1D_ENUM(name, label) L1D_##name,
+enum
+{
+    APEX_L1D_TABLE(APEX_L1D_ENUM)
+    NUM_L1D_OUTCOMES
+};
+
+typedef struct MSHR
+{
+    unsigned int line; /* tag of the line being filled, 0 when free */
+    int ready;         /* cycle the fill arrives */
+    int prefetch;      /* started by a prefetch, not yet wanted by a load */
+} MSHR;
+
+/*
+ * Tags are kept apart from the replacement state, with the ways of a set
+ * next to each other: a lookup reads one short row of ints and compares
+ * each to the key, with no pointer chasing or flags to test. A tag is the
+ * line address plus one, so 0 never matches and stands for an empty way.
+ */
+typedef struct APEX_Cache
+{
+    int policy;
+    const char *policy_name;
+    int sets;
+    int assoc;
+    int set_bits;
+    int line_bits;
+    int hit_latency;
+    int miss_latency;
+    unsigned int *tags;   /* sets * assoc */
+    unsigned int *stamps; /* lru: the access count at each way's last use */
+    unsigned int *plru;   /* plru: assoc - 1 tree bits per set */
+    unsigned char *prefetched; /* sets * assoc, brought in by a prefetch and not used yet */
+    unsigned int clock;   /* accesses so far, for the lru stamps */
+    unsigned int rng;     /* random: xorshift state */
+    int num_mshrs;
+    MSHR mshr[MAX_MSHRS];
+    char name[96];        /* geometry and timing, for the report */
+} APEX_Cache;
+
+APEX_Cache *apex_cache_create(int size, int assoc, int line, const char *policy, int hit_latency,
+                              int miss_latency, int mshrs);
+void apex_cache_free(APEX_Cache *cache);
+int apex_cache_load(APEX_Cache *cache, int address, int now, int *ready);
+int apex_cache_store(APEX_Cache *cache, int address);
+int apex_cache_prefetch(APEX_Cache *cache, int address, int now);
+int apex_cache_next_fill(const APEX_Cache *cache, int now);
+
+#endif
@@ -0,0 +1,508 @@
+/*
+ * apex_cpi.c
+ * Reads the instruction lifetimes written with --timestamps, breaks the
+ * run down into a CPI stack and walks the dynamic critical path back from
+ * the last commit.
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_trace.h"
+
+/*
+ * CPI stack components, X(name, label). Every cycle is charged to the
+ * oldest uncommitted instruction, by where it was in its life then:
+ * - frontend bubble: not dispatched yet, including the cycle from dispatch
+ *   to the earliest issue, or not fetched yet after a redirect (the
+ *   fetch_from_next_cycle bubble and the redirect itself)
+ * - branch recovery: the first instruction after a redirect refilling the
+ *   pipeline, from its fetch until its result
+ * - dependency wait: in the IQ waiting on a source operand
+ * - FU contention: ready but its unit was taken
+ * - execute latency: in its function unit
+ * - memory ordering: a load or store past its m1/m2 pipe, waiting in the
+ *   LSQ for the data of a store, its own or an older one's, or for an L1D
+ *   fill
+ * - base: complete and committing
+ */
+#define CPI_TABLE(X)                   \
+    X(BASE, "base")                    \
+    X(FRONTEND, "frontend bubble")     \
+    X(BRANCH, "branch recovery")       \
+    X(DEPENDENCY, "dependency wait")   \
+    X(FU, "FU contention")             \
+    X(EXECUTE, "execute latency")      \
+    X(MEMORY, "memory ordering")
+
+#define CPI_ENUM(name, label) CPI_##name,
+enum
+{
+    CPI_TABLE(CPI_ENUM)
+    NUM_CPI
+};
+
+#define CPI_LABEL(name, label) label,
+static const char *const cpi_labels[NUM_CPI] = {CPI_TABLE(CPI_LABEL)};
+
+/* Edges the critical path can take, X(name, label) */
+#define PATH_TABLE(X)                     \
+    X(DISPATCH, "in-order dispatch")      \
+    X(REDIRECT, "branch redirect")        \
+    X(ROB_FULL, "ROB full")               \
+    X(DATA, "data dependence")            \
+    X(FU, "FU contention")                \
+    X(MEMORY, "memory ordering")          \
+    X(EXECUTE, "execute")                 \
+    X(COMMIT, "in-order commit")
+
+#define PATH_ENUM(name, label) PATH_##name,
+enum
+{
+    PATH_TABLE(PATH_ENUM)
+    NUM_PATH
+};
+
+#define PATH_LABEL(name, label) label,
+static const char *const path_labels[NUM_PATH] = {PATH_TABLE(PATH_LABEL)};
+
+/* Nodes of one instruction on the path, latest first */
+enum
+{
+    NODE_COMMIT,
+    NODE_COMPLETE,
+    NODE_ISSUE,
+    NODE_READY,
+    NODE_RENAME
+};
+
+#define MAX_PRODUCERS 4
+#define ADDR_HASH_BITS 16
+#define TOP_INSNS 10
+
+typedef struct Insn
+{
+    APEX_Trace_Lifetime life;
+    int producers[MAX_PRODUCERS]; /* committed instructions it read, -1 if none */
+    int is_mem;
+    int latency; /* cycles of its function unit with nothing to wait for */
+} Insn;
+
+typedef struct Analysis
+{
+    APEX_Trace_Reader reader;
+    Insn *insns;
+    int count;
+    unsigned long long cpi[NUM_CPI];
+    unsigned long long path[NUM_PATH];
+    unsigned long long *path_by_pc; /* critical path cycles of each static instruction */
+} Analysis;
+
+static void
+load_insns(Analysis *an)
+{
+    int cap = 1024;
+
+    an->insns = malloc(cap * sizeof(Insn));
+    if (!an->insns)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate %d records\n", cap);
+        exit(1);
+    }
+    while (apex_trace_read(&an->reader, &an->insns[an->count].life, sizeof(APEX_Trace_Lifetime)) ==
+           sizeof(APEX_Trace_Lifetime))
+    {
+        if (an->insns[an->count].life.pc_index >= an->reader.code_size)
+        {
+            fprintf(stderr, "APEX_Error: record %d has a pc outside the program\n", an->count);
+            exit(1);
+        }
+        if (++an->count == cap)
+        {
+            Insn *grown = realloc(an->insns, 2 * cap * sizeof(Insn));
+
+            if (!grown)
+            {
+                fprintf(stderr, "APEX_Error: Unable to allocate %d records\n", 2 * cap);
+                exit(1);
+            }
+            an->insns = grown;
+            cap *= 2;
+        }
+    }
+}
+
+/* Links each instruction to the committed instructions that produced its
+ * register sources and, for a load, the last store to the same address.
+ * Stores are remembered in a direct-mapped table, a load whose store was
+ * evicted by another address just loses that link. */
+static void
+link_producers(Analysis *an)
+{
+    int last_writer[RENAME_TABLE_SIZE];
+    static struct
+    {
+        int addr;
+        int store;
+    } stores[1 << ADDR_HASH_BITS];
+
+    memset(last_writer, 0xff, sizeof(last_writer));
+    memset(stores, 0xff, sizeof(stores));
+    for (int i = 0; i < an->count; i++)
+    {
+        Insn *insn = &an->insns[i];
+        const APEX_Trace_Insn *code = &an->reader.code[insn->life.pc_index];
+        const APEX_Opcode_Info *info = OPCODE_INFO(code->opcode);
+        const int srcs[] = {code->rs1, code->rs2, code->rs3};
+        int n = 0;
+        unsigned h = ((unsigned)insn->life.mem_addr * 2654435761u) >> (32 - ADDR_HASH_BITS);
+
+        insn->is_mem = (info->flags & (INSN_IS_LOAD | INSN_IS_STORE)) != 0;
+        insn->latency = info->latency;
+        for (int s = 0; s < info->num_srcs; s++)
+        {
+            insn->producers[n++] = last_writer[srcs[s]];
+        }
+        if (info->flags & INSN_READS_ZERO)
+        {
+            insn->producers[n++] = last_writer[ZERO_FLAG_REG];
+        }
+        if ((info->flags & INSN_IS_LOAD) && stores[h].store >= 0 && stores[h].addr == insn->life.mem_addr)
+        {
+            insn->producers[n++] = stores[h].store;
+        }
+        while (n < MAX_PRODUCERS)
+        {
+            insn->producers[n++] = -1;
+        }
+
+        if (info->flags & INSN_HAS_DEST)
+        {
+            last_writer[code->rd] = i;
+        }
+        if (info->flags & INSN_SETS_ZERO)
+        {
+            last_writer[ZERO_FLAG_REG] = i;
+        }
+        if (info->flags & INSN_IS_STORE)
+        {
+            stores[h].addr = insn->life.mem_addr;
+            stores[h].store = i;
+        }
+    }
+}
+
+/* Cycles of (from, to] that fall in (prev, commit]. A timestamp is the
+ * cycle its event happened in, which closes the phase before it. */
+static long long
+overlap(long long from, long long to, long long prev, long long commit)
+{
+    long long lo = from > prev ? from : prev;
+    long long hi = to < commit ? to : commit;
+
+    return hi > lo ? hi - lo : 0;
+}
+
+/* First cycle the instruction could issue in: the IQ is read before decode
+ * writes it, so never the cycle it was dispatched. HALT and NOP do not
+ * issue, their times all equal the rename cycle. */
+static long long
+issuable(const INSN_TIMES *t)
+{
+    if (t->issue == t->rename)
+    {
+        return t->rename;
+    }
+    return t->ready > t->rename ? t->ready : t->rename + 1;
+}
+
+static void
+build_cpi_stack(Analysis *an)
+{
+    for (int i = 0; i < an->count; i++)
+    {
+        const INSN_TIMES *t = &an->insns[i].life.times;
+        long long prev = i ? an->insns[i - 1].life.times.commit : 0;
+        long long c = t->commit;
+        long long dispatched = t->rename + (t->issue > t->rename);
+
+        if (i && an->insns[i - 1].life.redirected)
+        {
+            an->cpi[CPI_FRONTEND] += overlap(LLONG_MIN, t->fetch, prev, c);
+            an->cpi[CPI_BRANCH] += overlap(t->fetch, t->complete, prev, c);
+        }
+        else
+        {
+            an->cpi[CPI_FRONTEND] += overlap(LLONG_MIN, dispatched, prev, c);
+            an->cpi[CPI_DEPENDENCY] += overlap(dispatched, issuable(t), prev, c);
+            an->cpi[CPI_FU] += overlap(issuable(t), t->issue, prev, c);
+            if (an->insns[i].is_mem)
+            {
+                long long piped = t->issue + an->insns[i].latency;
+
+                an->cpi[CPI_EXECUTE] += overlap(t->issue, piped, prev, c);
+                an->cpi[CPI_MEMORY] += overlap(piped, t->complete, prev, c);
+            }
+            else
+            {
+                an->cpi[CPI_EXECUTE] += overlap(t->issue, t->complete, prev, c);
+            }
+        }
+        an->cpi[CPI_BASE] += overlap(t->complete, LLONG_MAX, prev, c);
+    }
+}
+
+static void
+charge_path(Analysis *an, int edge, int i, long long cycles)
+{
+    an->path[edge] += cycles;
+    an->path_by_pc[an->insns[i].life.pc_index] += cycles;
+}
+
+/* A load or store that outlived its m1/m2 pipe waited in the LSQ for store
+ * data, its own or an older store's: the producer that delivered last after
+ * it issued, -1 if it did not wait */
+static int
+store_data_producer(const Analysis *an, int i)
+{
+    const Insn *insn = &an->insns[i];
+    const INSN_TIMES *t = &insn->life.times;
+    int latest = -1;
+
+    if (!insn->is_mem || t->complete <= t->issue + insn->latency)
+    {
+        return -1;
+    }
+    for (int p = 0; p < MAX_PRODUCERS; p++)
+    {
+        int producer = insn->producers[p];
+        long long done = producer >= 0 ? an->insns[producer].life.times.complete : 0;
+
+        if (producer >= 0 && done > t->issue && done <= t->complete &&
+            (latest < 0 || done > an->insns[latest].life.times.complete))
+        {
+            latest = producer;
+        }
+    }
+    return latest;
+}
+
+/* Walks back from the last commit, at every node following the input that
+ * arrived last; the time between that arrival and the node is charged to
+ * the edge. The walk ends at the rename of the first instruction. */
+static void
+walk_critical_path(Analysis *an)
+{
+    int i = an->count - 1;
+    int node = NODE_COMMIT;
+
+    while (i >= 0)
+    {
+        const Insn *insn = &an->insns[i];
+        const INSN_TIMES *t = &insn->life.times;
+        const INSN_TIMES *prev = i ? &an->insns[i - 1].life.times : NULL;
+
+        switch (node)
+        {
+        case NODE_COMMIT:
+            if (prev && prev->commit > t->complete)
+            {
+                charge_path(an, PATH_COMMIT, i, t->commit - prev->commit);
+                i--;
+            }
+            else
+            {
+                charge_path(an, PATH_COMMIT, i, t->commit - t->complete);
+                node = NODE_COMPLETE;
+            }
+            break;
+
+        case NODE_COMPLETE:
+        {
+            int latest = store_data_producer(an, i);
+
+            if (latest >= 0)
+            {
+                charge_path(an, PATH_MEMORY, i, t->complete - an->insns[latest].life.times.complete);
+                i = latest;
+            }
+            else
+            {
+                // beyond the pipe a load with nothing to wait for was missing in the L1D
+                long long piped = insn->is_mem && t->complete > t->issue + insn->latency
+                                      ? t->issue + insn->latency
+                                      : t->complete;
+
+                charge_path(an, PATH_MEMORY, i, t->complete - piped);
+                charge_path(an, PATH_EXECUTE, i, piped - t->issue);
+                node = NODE_ISSUE;
+            }
+            break;
+        }
+
+        case NODE_ISSUE:
+            charge_path(an, PATH_FU, i, t->issue - issuable(t));
+            node = NODE_READY;
+            break;
+
+        case NODE_READY:
+        {
+            int latest = -1;
+
+            // a JAL hands its link value on a cycle before it completes,
+            // a producer that looks later than the consumer is not followed
+            for (int p = 0; p < MAX_PRODUCERS; p++)
+            {
+                int producer = insn->producers[p];
+                long long done = producer >= 0 ? an->insns[producer].life.times.complete : 0;
+
+                if (producer >= 0 && done <= issuable(t) &&
+                    (latest < 0 || done > an->insns[latest].life.times.complete))
+                {
+                    latest = producer;
+                }
+            }
+            if (latest >= 0 && an->insns[latest].life.times.complete > t->rename)
+            {
+                charge_path(an, PATH_DATA, i, issuable(t) - an->insns[latest].life.times.complete);
+                node = NODE_COMPLETE;
+                i = latest;
+            }
+            else
+            {
+                charge_path(an, PATH_DISPATCH, i, issuable(t) - t->rename);
+                node = NODE_RENAME;
+            }
+            break;
+        }
+
+        case NODE_RENAME:
+        {
+            // dispatch follows the previous one, a redirect, or a ROB entry
+            // freed by a commit; ties go to the more specific cause
+            int rob_limit = i - (ROB_SIZE - 1);
+            long long arrival = prev ? prev->rename : 0;
+            int edge = PATH_DISPATCH, from = i - 1, to = NODE_RENAME;
+
+            if (rob_limit >= 0 && an->insns[rob_limit].life.times.commit >= arrival)
+            {
+                arrival = an->insns[rob_limit].life.times.commit;
+                edge = PATH_ROB_FULL, from = rob_limit, to = NODE_COMMIT;
+            }
+            if (prev && an->insns[i - 1].life.redirected && prev->complete >= arrival)
+            {
+                arrival = prev->complete;
+                edge = PATH_REDIRECT, from = i - 1, to = NODE_COMPLETE;
+            }
+            charge_path(an, edge, i, t->rename - arrival);
+            node = to;
+            i = from;
+            break;
+        }
+        }
+    }
+}
+
+typedef struct Hot_Insn
+{
+    int pc_index;
+    unsigned long long cycles;
+} Hot_Insn;
+
+static int
+by_cycles(const void *a, const void *b)
+{
+    const Hot_Insn *x = a, *y = b;
+
+    if (x->cycles != y->cycles)
+    {
+        return x->cycles < y->cycles ? 1 : -1;
+    }
+    return x->pc_index - y->pc_index;
+}
+
+static void
+report(const Analysis *an)
+{
+    unsigned long long cycles = an->count ? an->insns[an->count - 1].life.times.commit : 0;
+    Hot_Insn *hot = calloc(an->reader.code_size + 1, sizeof(Hot_Insn));
+
+    if (!hot)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the report\n");
+        exit(1);
+    }
+    printf("APEX_CPI: %d instructions, %llu cycles, CPI %.3f\n", an->count, cycles,
+           an->count ? (double)cycles / an->count : 0.0);
+    printf("----------------------------------------\n%s\n----------------------------------------\n", " CPI STACK");
+    for (int i = 0; i < NUM_CPI; i++)
+    {
+        printf("   %-18s %10llu  %7.3f  %5.1f%%\n", cpi_labels[i], an->cpi[i],
+               an->count ? (double)an->cpi[i] / an->count : 0.0,
+               cycles ? 100.0 * an->cpi[i] / cycles : 0.0);
+    }
+    printf("----------------------------------------\n%s\n----------------------------------------\n", " CRITICAL PATH");
+    for (int i = 0; i < NUM_PATH; i++)
+    {
+        printf("   %-18s %10llu  %5.1f%%\n", path_labels[i], an->path[i],
+               cycles ? 100.0 * an->path[i] / cycles : 0.0);
+    }
+
+    // the static instructions the path spends the most cycles in
+    for (uint32_t pc = 0; pc < an->reader.code_size; pc++)
+    {
+        hot[pc].pc_index = pc;
+        hot[pc].cycles = an->path_by_pc[pc];
+    }
+    qsort(hot, an->reader.code_size, sizeof(Hot_Insn), by_cycles);
+    printf("   on the path:\n");
+    for (uint32_t i = 0; i < an->reader.code_size && i < TOP_INSNS && hot[i].cycles; i++)
+    {
+        char text[64];
+
+        apex_trace_format_insn(&an->reader.code[hot[i].pc_index], text, sizeof(text));
+        printf("     pc(%-4d) %-20s %10llu  %5.1f%%\n", 4000 + 4 * hot[i].pc_index, text,
+               hot[i].cycles, cycles ? 100.0 * hot[i].cycles / cycles : 0.0);
+    }
+    free(hot);
+}
+
+int
+main(int argc, char const *argv[])
+{
+    Analysis an;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "APEX_Help: Usage apex_cpi {timestamps_file}\n");
+        exit(1);
+    }
+    memset(&an, 0, sizeof(an));
+    if (!apex_trace_reader_open(&an.reader, argv[1], APEX_LIFETIME_MAGIC))
+    {
+        exit(1);
+    }
+    an.path_by_pc = calloc(an.reader.code_size + 1, sizeof(unsigned long long));
+    if (!an.path_by_pc)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the critical path\n");
+        exit(1);
+    }
+    load_insns(&an);
+    link_producers(&an);
+    build_cpi_stack(&an);
+    walk_critical_path(&an);
+    report(&an);
+
+    apex_trace_reader_close(&an.reader);
+    free(an.insns);
+    free(an.path_by_pc);
+    return 0;
+}
@@ -13,6 +13,19 @@
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
+#include "apex_simd.h"
+#include "apex_stream.h"
+#include "apex_trace.h"
+
+/* Records a pipeline event when an event trace is open */
+#define RECORD_EVENT(cpu, type, seq, pc, arg)                                           \
+    do                                                                                  \
+    {                                                                                   \
+        if ((cpu)->event_trace)                                                         \
+        {                                                                               \
+            apex_trace_emit((cpu)->event_trace, EV_##type, (cpu)->clock, seq, pc, arg); \
+        }                                                                               \
+    } while (0)
 
 /* Converts the PC(4000 series) into array index for code memory
  *
@@ -22,8 +35,8 @@
 //    int loop;
 
 //     for(loop = 0; loop < REG_FILE_SIZE; loop++){
-//         printf("%d : status -> %d, value -> %d",loop, arr[loop].is_available, arr[loop].value);
-//         printf("\n");
+//         apex_printf("%d : status -> %d, value -> %d",loop, arr[loop].is_available, arr[loop].value);
+//         apex_printf("\n");
 
 //     }
 //     return 0;
@@ -38,88 +51,25 @@ get_code_memory_index_from_pc(const int pc)
 void
 print_instruction(const CPU_Stage *stage, int has_insn)
 {
-    // printf("stats opcode %d \n", stage->opcode);
     if (has_insn)
     {
+        /* Operand values indexed by OPND_* */
+        const int operands[] = {0, stage->rd, stage->rs1, stage->rs2, stage->rs3, stage->imm};
+        const int *format = format_operands[OPCODE_INFO(stage->opcode)->format];
 
-        switch (stage->opcode)
+        apex_printf("%s", get_opcode_str(stage->opcode));
+        for (int i = 0; i < MAX_OPERANDS && format[i] != OPND_NONE; ++i)
         {
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_MUL:
-        case OPCODE_DIV:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_LDR:
-        case OPCODE_XOR:
-        {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->rs2);
-            break;
-        }
-
-        case OPCODE_MOVC:
-        {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
-            break;
-        }
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        case OPCODE_LOAD:
-        case OPCODE_JAL:
-        {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->imm);
-            break;
-        }
-        
-        case OPCODE_JUMP:
-        {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rs1, stage->imm);
-            break;
-        }
-
-        case OPCODE_STORE:
-        {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
-                   stage->imm);
-            break;
-        }
-        case OPCODE_STR:
-        {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2,
-                   stage->rs3);
-            break;
-        }
-        case OPCODE_CMP:
-        {
-            printf("%s,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2);
-            break;
-        }
-
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        {
-            printf("%s,#%d ", stage->opcode_str, stage->imm);
-            break;
-        }
-
-        case OPCODE_HALT:
-        {
-            printf("%s", stage->opcode_str);
-            break;
+            apex_printf(format[i] == OPND_IMM ? ",#%d" : ",R%d", operands[format[i]]);
         }
-
-        case OPCODE_NOP:
+        if (format[0] != OPND_NONE)
         {
-            printf("NOP");
-            break;
-        }
+            apex_printf(" ");
         }
     }
     else
     {
-        printf("EMPTY");
+        apex_printf("EMPTY");
     }
 }
 /* Debug function which prints the CPU stage content
@@ -131,14 +81,14 @@ print_stage_content(const char *name, const CPU_Stage *stage, int has_insn)
 {
     if (stage->opcode == 0)
     {
-        printf("%-15s: ", name);
+        apex_printf("%-15s: ", name);
     }
     else
     {
-        printf("%-15s: pc(%-4d) ", name, stage->pc);
+        apex_printf("%-15s: pc(%-4d) ", name, stage->pc);
     }
     print_instruction(stage, has_insn);
-    printf("\n");
+    apex_printf("\n");
 }
 
 /* Debug function which prints the register file
@@ -148,34 +98,62 @@ print_stage_content(const char *name, const CPU_Stage *stage, int has_insn)
 void
 print_reg_file(const APEX_CPU *cpu)
 {
-    printf("----------------------------------------\n%s\n----------------------------------------\n", "State of Architectural Registers:");
+    apex_printf("----------------------------------------\n%s\n----------------------------------------\n", "State of Architectural Registers:");
     char r[] = "| Registers |";
     char v[] = "Value |";
     char s[] = "Status |";
-    printf("%-7s %7s %7s\n", r, s, v);
+    apex_printf("%-7s %7s %7s\n", r, s, v);
     for (int i = 0; i < REG_FILE_SIZE; ++i)
     {
-        printf("   R%-11d%-8d[%-3d]\n", i, cpu->regs[i].status, cpu->regs[i].value);
+        apex_printf("   R%-11d%-8d[%-3d]\n", i, cpu->regs[i].status, cpu->regs[i].value);
     }
 
-    printf("\n");
+    apex_printf("\n");
 }
 
 void
 print_data_mem(const APEX_CPU *cpu)
 {
-    printf("----------------------------------------\n%s\n----------------------------------------\n", " STATE OF DATA MEMORY");
+    apex_printf("----------------------------------------\n%s\n----------------------------------------\n", " STATE OF DATA MEMORY");
 
     for (int i = 0; i < 10; ++i)
     {
 
-        printf("   MEM%-11d \t\t Data Value = %d\n", i, cpu->data_memory[i]);
+        apex_printf("   MEM%-11d \t\t Data Value = %d\n", i, apex_mem_read(cpu->data_memory, i));
     }
 
-    printf("\n");
+    apex_printf("\n");
 }
 /* No Operation filler created to add a bubble into the pipeline during dependencies */
 
+/* Picks the pc to fetch after a branch: for a JUMP the return address on
+ * top of the RAS, else the BTB target when the predictor says taken and
+ * the BTB knows the branch, the next instruction otherwise. The guess and
+ * the history and RAS it was made with travel with the branch. */
+static void
+predict_branch(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    APEX_Bpred *bp = cpu->bpred;
+    int conditional = (stage->flags & INSN_READS_ZERO) != 0;
+    int target;
+
+    stage->bp_hist = bp->hist;
+    apex_bpred_ras_save(bp, &stage->ras);
+    stage->pred_taken = (stage->opcode == OPCODE_JUMP && apex_bpred_ras_pop(bp, &target)) ||
+                        (bp->uses_btb && apex_bpred_btb_lookup(bp, stage->pc, &target) &&
+                         (!conditional || bp->predict(bp, stage->pc, bp->hist)));
+    stage->pred_target = stage->pred_taken ? target : stage->pc + 4;
+    if (conditional)
+    {
+        apex_bpred_push_history(bp, stage->pred_taken);
+    }
+    if (stage->opcode == OPCODE_JAL)
+    {
+        apex_bpred_ras_push(bp, stage->pc + 4);
+    }
+    cpu->pc = stage->pred_target;
+}
+
 /*
  * Fetch Stage of APEX Pipeline
  *
@@ -188,7 +166,7 @@ APEX_fetch(APEX_CPU *cpu)
 {
     APEX_Instruction *current_ins;
 
-    // printf("cpu->fetch.has_insn %d",cpu->fetch.has_insn);
+    // apex_printf("cpu->fetch.has_insn %d",cpu->fetch.has_insn);
     if (cpu->fetch.has_insn)
     {
         /* This fetches new branch target instruction from next cycle */
@@ -200,74 +178,87 @@ APEX_fetch(APEX_CPU *cpu)
             return;
         }
 
-        /* Store current PC in fetch latch */
-        cpu->fetch.pc = cpu->pc;
-
-        /* Index into code memory using this pc and copy all instruction fields
-         * into fetch latch  */
-        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-        cpu->fetch.opcode = current_ins->opcode;
-        cpu->fetch.rd = current_ins->rd;
-        cpu->fetch.rs1 = current_ins->rs1;
-        cpu->fetch.rs2 = current_ins->rs2;
-        cpu->fetch.rs3 = current_ins->rs3;
-        cpu->fetch.imm = current_ins->imm;
-        
-        if(is_branch_inst(current_ins->opcode) == TRUE){
-            
-            //checkpointing if it is a branch instruction
-            if(is_bis_full(&cpu->bis_queue)){
-                cpu->stop_dispatch = TRUE;
-            }else{
-                cpu->bis_queue.tail++;
-                cpu->bis_queue.slots[cpu->bis_queue.tail] = cpu->rob_queue.tail;
-                for (int i = 0; i < BIS_SIZE; i++)
+        /* Up to fetch_width sequential instructions a cycle, as many as
+         * the decode latch has room for; a bundle ends at a HALT or after
+         * a branch predicted taken */
+        for (int n = 0; n < cpu->fetch_width && cpu->fetch.has_insn; n++)
+        {
+            int stalled = cpu->decode_count == cpu->fetch_width;
+
+            /* A wrong path can run off the program, e.g. falling through
+             * the last JUMP; fetch waits there for the redirect */
+            if (cpu->pc < 4000 || get_code_memory_index_from_pc(cpu->pc) >= cpu->code_memory_size)
+            {
+                cpu->fetch.has_insn = FALSE;
+                return;
+            }
+
+            /* Store current PC in fetch latch */
+            cpu->fetch.pc = cpu->pc;
+
+            /* Index into code memory using this pc and copy all instruction fields
+             * into fetch latch  */
+            current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
+            cpu->fetch.opcode = current_ins->opcode;
+            cpu->fetch.fu_class = current_ins->fu_class;
+            cpu->fetch.latency = current_ins->latency;
+            cpu->fetch.flags = current_ins->flags;
+            cpu->fetch.rd = current_ins->rd;
+            cpu->fetch.rs1 = current_ins->rs1;
+            cpu->fetch.rs2 = current_ins->rs2;
+            cpu->fetch.rs3 = current_ins->rs3;
+            cpu->fetch.imm = current_ins->imm;
+
+            /* Branches go where the predictor says, the decode stage
+             * checkpoints them when they are dispatched */
+            if (!stalled)
+            {
+                /* Copy data from fetch latch to the next free decode entry */
+                CPU_Stage *inst = &cpu->decode[cpu->decode_count++];
+
+                *inst = cpu->fetch;
+                inst->has_insn = TRUE;
+                inst->seq = cpu->next_seq++;
+                inst->times.fetch = cpu->clock;
+                RECORD_EVENT(cpu, FETCH, inst->seq, inst->pc, 0);
+
+                /* Update PC for next instruction */
+                if (inst->flags & INSN_IS_BRANCH)
+                {
+                    predict_branch(cpu, inst);
+                }
+                else
                 {
-                    if(cpu->cpu_store[i].is_free){
-                        cpu->fetch.checkpoint_info = i;
-                        memcpy(cpu->cpu_store[i].rename_table, cpu->rename_table, sizeof(cpu->cpu_store[i].rename_table));
-                        memcpy(cpu->cpu_store[i].regs, cpu->regs, sizeof(cpu->cpu_store[i].regs));
-                        break;
+                    if (inst->flags & INSN_IS_LOAD)
+                    {
+                        // a replay of the load puts the predictor back to here
+                        inst->bp_hist = cpu->bpred->hist;
+                        apex_bpred_ras_save(cpu->bpred, &inst->ras);
                     }
+                    cpu->pc += 4;
                 }
             }
-            
-        }
-        
-        if (cpu->stop_dispatch == TRUE || cpu->is_branch_taken == TRUE)
-        {
-            // Do nothing
-        }
-        else
-        {
-            /* Copy data from fetch latch to decode latch*/
-            cpu->decode = cpu->fetch;
-            cpu->decode.has_insn = TRUE;
-
-            /* Update PC for next instruction */
-            cpu->pc += 4;
-        }
 
-        if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
-        {
-            print_stage_content("Fetch", &cpu->fetch, cpu->fetch.has_insn);
-        }
+            if (TRACE_ON(cpu, TRACE_STAGE) && cpu->simulation_enabled == FALSE)
+            {
+                print_stage_content("Fetch", &cpu->fetch, cpu->fetch.has_insn);
+            }
 
-        /* Stop fetching new instructions if HALT is fetched */
-        if (cpu->fetch.opcode == OPCODE_HALT)
-        {
-            if(cpu->is_jal_active.status == TRUE){
-               cpu->pc = cpu->regs[cpu->is_jal_active.reg_index].value;
-            }else{
+            /* Stop fetching new instructions once a HALT is in decode, only
+             * a redirect starts fetch again */
+            if (!stalled && cpu->fetch.opcode == OPCODE_HALT)
+            {
                 cpu->fetch.has_insn = FALSE;
-                cpu->fetch.opcode = 0;
+            }
+            if (stalled || cpu->pc != cpu->fetch.pc + 4)
+            {
+                break;
             }
         }
     }
     else
     {
-        if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
+        if (TRACE_ON(cpu, TRACE_STAGE) && cpu->simulation_enabled == FALSE)
             print_stage_content("Fetch", &cpu->fetch, FALSE);
     }
 }
@@ -280,7 +271,7 @@ void initialize_rob(ROB *rob)
 
 int is_rob_empty(ROB *rob)
 {
-    return (rob->tail == -1);
+    return (rob->tail == rob->head);
 }
 
 int is_rob_full(ROB *rob)
@@ -311,52 +302,33 @@ int is_rob_full(ROB *rob)
 /* Utility Function for BIS*/
 void initialize_bis(BIS *bis)
 {
-    bis->tail = -1;
-    bis->head = -1;
+    bis->in_flight = 0;
 }
 
 int is_bis_empty(BIS *bis)
 {
-    return (bis->tail == -1);
+    return (bis->in_flight == 0);
 }
 
 int is_bis_full(BIS *bis)
 {
-    return ((bis->tail + 1) % BIS_SIZE == bis->head);
+    return (bis->in_flight == (BIS_SIZE == 32 ? ~0u : (1u << BIS_SIZE) - 1));
 }
-/* remove from head of rob */
 
-void remove_from_bis(BIS *bis)
+/* Frees the id of a resolved branch */
+void remove_from_bis(BIS *bis, int branch_id)
 {
-    int empty_slot = 0;
-
-    bis->slots[bis->head] = empty_slot;
-
-    if (bis->tail == bis->head)
-    { //delete the last element
-        // reset the head and tail of rob
-        bis->tail = -1;
-        bis->head = -1;
-    }
-    else
-    {
-        bis->head = (bis->head + 1) % BIS_SIZE;
-    }
+    bis->in_flight &= ~(1u << branch_id);
 }
 
-void add_into_bis(BIS *bis, int rob_index)
+/* Hands out the lowest free id, the caller checks is_bis_full first */
+int add_into_bis(BIS *bis, int rob_index)
 {
-    if (is_bis_empty(bis))
-    {
-        bis->tail = 0;
-        bis->head = 0;
-        bis->slots[0] = rob_index;
-    }
-    else
-    {
-        bis->tail = (bis->tail + 1) % BIS_SIZE;
-        bis->slots[bis->tail] = rob_index;
-    }
+    int branch_id = __builtin_ctz(~bis->in_flight);
+
+    bis->in_flight |= 1u << branch_id;
+    bis->rob_index[branch_id] = rob_index;
+    return branch_id;
 }
 
 /*Utitity Function for issue Queue*/
@@ -377,144 +349,150 @@ int get_entry_from_backend_rename_table(APEX_CPU *cpu, int dest_reg){
     return cpu->back_end_table[dest_reg];
 }
 
-int get_free_reg_from_RF(APEX_CPU *cpu){
-    int free_reg = 0;
-    for (int i = 0; i < REG_FILE_SIZE; i++)
+/* Utility Functions for the physical register free list */
+void initialize_free_list(FREE_LIST *free_list){
+    memset(free_list->bits, 0, sizeof(free_list->bits));
+    free_list->count = 0;
+}
+
+int allocate_from_free_list(FREE_LIST *free_list){
+    for (int i = 0; i < FREE_LIST_WORDS; i++)
     {
-        if(cpu->regs[i].is_free){
-            cpu->regs[i].is_free = FALSE;
-            cpu->regs[i].status = INVALID;
-            free_reg = i;
-            break;
+        if(free_list->bits[i]){
+            int bit = __builtin_ctzll(free_list->bits[i]);
+            free_list->bits[i] &= free_list->bits[i] - 1;
+            free_list->count--;
+            return i * 64 + bit;
         }
     }
-    // print_reg_file(cpu);
-
-    return free_reg;
+    return -1;
 }
-int is_free_reg_from_RF_available(APEX_CPU *cpu){
-    int free_reg = FALSE;
-    for (int i = 0; i < REG_FILE_SIZE; i++)
-    {
-        if(cpu->regs[i].is_free == TRUE){
-            free_reg = TRUE;
-            break;
-        }
+
+void release_to_free_list(FREE_LIST *free_list, int phy_reg){
+    unsigned long long mask = 1ULL << (phy_reg % 64);
+    if(!(free_list->bits[phy_reg / 64] & mask)){
+        free_list->bits[phy_reg / 64] |= mask;
+        free_list->count++;
     }
+}
 
+int get_free_reg_from_RF(APEX_CPU *cpu){
+    int free_reg = allocate_from_free_list(&cpu->free_list);
+    cpu->regs[free_reg].status = INVALID;
     return free_reg;
 }
 
+int is_free_reg_from_RF_available(APEX_CPU *cpu){
+    return cpu->free_list.count > 0;
+}
+
 int is_iq_empty(IQ *iq)
 {
-    return (iq->tail == -1);
+    return (iq->count == 0);
 }
 
 int is_iq_full(IQ *iq)
 {
-    int res = TRUE;
-    for (int i = 0; i < IQ_SIZE; i++)
+    return (iq->count == IQ_SIZE);
+}
+
+void remove_from_iq(IQ *iq, int slot)
+{
+    unsigned long long mask = ~(1ULL << (slot % 64));
+
+    iq->occupied[slot / 64] &= mask;
+    iq->ready[slot / 64] &= mask;
+    iq->src1_pending[slot / 64] &= mask;
+    iq->src2_pending[slot / 64] &= mask;
+    iq->count--;
+}
+
+/* Writes a produced value into the register file and wakes up the IQ
+ * entries whose pending source tags match it */
+void broadcast_result(APEX_CPU *cpu, int phy_reg, int value)
+{
+    IQ *iq = &cpu->issue_queue_entry;
+    unsigned long long hit1[IQ_WORDS];
+    unsigned long long hit2[IQ_WORDS];
+
+    cpu->regs[phy_reg].value = value;
+    cpu->regs[phy_reg].status = VALID;
+    tag_match(iq->src1_tag, IQ_WORDS * 64, phy_reg, hit1);
+    tag_match(iq->src2_tag, IQ_WORDS * 64, phy_reg, hit2);
+    for (int i = 0; i < IQ_WORDS; i++)
     {
-        if(iq->slots[i].status == UNALLOCATED){
-            iq->tail = i;
-            res = FALSE;
-            break;
+        unsigned long long woken1 = hit1[i] & iq->src1_pending[i];
+        unsigned long long woken2 = hit2[i] & iq->src2_pending[i];
+
+        iq->src1_pending[i] &= ~woken1;
+        iq->src2_pending[i] &= ~woken2;
+        while (woken1)
+        {
+            iq->slots[i * 64 + __builtin_ctzll(woken1)].src1_val = value;
+            woken1 &= woken1 - 1;
+        }
+        while (woken2)
+        {
+            iq->slots[i * 64 + __builtin_ctzll(woken2)].src2_val = value;
+            woken2 &= woken2 - 1;
+        }
+        unsigned long long ready = iq->occupied[i] & ~(iq->src1_pending[i] | iq->src2_pending[i]);
+        unsigned long long woken = ready & ~iq->ready[i];
+
+        iq->ready[i] = ready;
+        while (woken)
+        {
+            cpu->rob_queue.slots[iq->slots[i * 64 + __builtin_ctzll(woken)].rob_index].times.ready = cpu->clock;
+            woken &= woken - 1;
         }
     }
-    return res;
 }
 
 IQ_SLOT create_entry_for_issue_queue(APEX_CPU *cpu, CPU_Stage *inst){
     IQ_SLOT iq_entry;
+    const APEX_Opcode_Info *info = OPCODE_INFO(inst->opcode);
     
     iq_entry.imm = inst->imm;
+    iq_entry.pc = inst->pc;
     iq_entry.opcode = inst->opcode;
-    strcpy(iq_entry.opcode_str, inst->opcode_str);
-    iq_entry.status = UNALLOCATED; // instruction is not allocated at first to function unit
-    iq_entry.bis_index = cpu->bis_queue.slots[cpu->bis_queue.head];
+    iq_entry.fu_class = inst->fu_class;
+    // INT, MUL and DIV run for their class's latency in the FU pool
+    iq_entry.latency = FU_IS_COMPUTE(inst->fu_class) ? cpu->fu_config[inst->fu_class].latency : inst->latency;
+    iq_entry.flags = inst->flags;
+    iq_entry.branch_mask = inst->branch_mask;
+    iq_entry.branch_id = inst->branch_id;
+    iq_entry.pred_taken = inst->pred_taken;
+    iq_entry.pred_target = inst->pred_target;
+    iq_entry.bp_hist = inst->bp_hist;
+    iq_entry.lsq_index = inst->lsq_index;
     iq_entry.rob_index = cpu->rob_queue.tail;
-    iq_entry.checkpoint_info = inst->checkpoint_info;
-    // mapping source registers tags, bits and values in iq
-    switch(inst->opcode){
-        case OPCODE_STR:
-        {
-            iq_entry.src1_tag = inst->rs2;
-            iq_entry.src2_tag = inst->rs3;
-            iq_entry.src1_bit = cpu->regs[iq_entry.src1_tag].is_free;
-            iq_entry.src2_bit = cpu->regs[iq_entry.src2_tag].is_free;
-            iq_entry.src1_val = cpu->regs[iq_entry.src1_tag].value;
-            iq_entry.src2_val = cpu->regs[iq_entry.src2_tag].value;
-            break;
-        }
-        
-        case OPCODE_STORE:
-        {
-            iq_entry.src1_tag = inst->rs2;
-            iq_entry.src1_bit = cpu->regs[iq_entry.src2_tag].is_free;
-            iq_entry.src1_val = cpu->regs[iq_entry.src2_tag].value;
-            break;
-        }
-        
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        case OPCODE_LOAD:
-        case OPCODE_JUMP:
-        case OPCODE_JAL:
-        {
-            iq_entry.src1_tag = inst->rs1;
-            iq_entry.src1_bit = cpu->regs[iq_entry.src1_tag].is_free;
-            iq_entry.src1_val = cpu->regs[iq_entry.src1_tag].value;
-            break;
-        }
-        
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_MUL:
-        case OPCODE_CMP:
-        case OPCODE_DIV:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_XOR:
-        case OPCODE_LDR:
-        {
-            iq_entry.src1_tag = inst->rs1;
-            iq_entry.src2_tag = inst->rs2;
-            iq_entry.src1_bit = cpu->regs[iq_entry.src1_tag].is_free;
-            iq_entry.src2_bit = cpu->regs[iq_entry.src2_tag].is_free;
-            iq_entry.src1_val = cpu->regs[iq_entry.src1_tag].value;
-            iq_entry.src2_val = cpu->regs[iq_entry.src2_tag].value;
-            break;
-        }
-        default:
-        {
-            break;
-        }
+    iq_entry.seq = inst->seq;
+    iq_entry.dest_reg = inst->rd;
+    iq_entry.flag_reg = inst->flag_reg;
+
+    // mapping source registers tags, bits and values in iq; the data of a
+    // store (rs1) is read at m1 so only its address operands wait here, a
+    // BZ/BNZ waits on the renamed zero flag decode put in rs1
+    iq_entry.num_srcs = info->num_srcs;
+    iq_entry.src1_tag = inst->rs1;
+    iq_entry.src2_tag = inst->rs2;
+    if (inst->flags & INSN_IS_STORE)
+    {
+        iq_entry.num_srcs--;
+        iq_entry.src1_tag = inst->rs2;
+        iq_entry.src2_tag = inst->rs3;
     }
-    
-    
-    // creating an entry inside rename table
-    switch(inst->opcode){
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        case OPCODE_LOAD:
-        case OPCODE_JAL:
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_MUL:
-        case OPCODE_CMP:
-        case OPCODE_DIV:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_XOR:
-        case OPCODE_LDR:
-        {
-            iq_entry.dest_reg = inst->rd;
-            break;
-        }
-        default:
-        {
-            break;
-        }
+    if (inst->flags & INSN_READS_ZERO)
+    {
+        iq_entry.num_srcs = 1;
+    }
+    if (iq_entry.num_srcs > 0)
+    {
+        iq_entry.src1_val = cpu->regs[iq_entry.src1_tag].value;
+    }
+    if (iq_entry.num_srcs > 1)
+    {
+        iq_entry.src2_val = cpu->regs[iq_entry.src2_tag].value;
     }
     
     return iq_entry;
@@ -522,33 +500,78 @@ IQ_SLOT create_entry_for_issue_queue(APEX_CPU *cpu, CPU_Stage *inst){
 
 void add_into_iq(APEX_CPU *cpu, CPU_Stage *inst)
 {
-    if (is_iq_empty(&cpu->issue_queue_entry))
+    IQ *iq = &cpu->issue_queue_entry;
+    for (int i = 0; i < IQ_WORDS; i++)
     {
-        cpu->issue_queue_entry.tail = 0;
-        cpu->issue_queue_entry.head = 0;
-        cpu->issue_queue_entry.slots[0] = create_entry_for_issue_queue(cpu, inst);
-    }
-    else
-    {
-        cpu->issue_queue_entry.slots[cpu->issue_queue_entry.tail] = create_entry_for_issue_queue(cpu, inst);
+        unsigned long long free_slots = ~iq->occupied[i];
+        if (free_slots)
+        {
+            int slot = i * 64 + __builtin_ctzll(free_slots);
+            unsigned long long bit = 1ULL << (slot % 64);
+            IQ_SLOT *entry = &iq->slots[slot];
+
+            *entry = create_entry_for_issue_queue(cpu, inst);
+            iq->src1_tag[slot] = entry->src1_tag;
+            iq->src2_tag[slot] = entry->src2_tag;
+            iq->branch_mask[slot] = (int)entry->branch_mask;
+            // everything already in the IQ is older than the new entry, and
+            // it is younger than all of them
+            for (int r = 0; r < IQ_SIZE; r++)
+            {
+                iq->older[r][i] &= ~bit;
+            }
+            memcpy(iq->older[slot], iq->occupied, sizeof(iq->occupied));
+            iq->occupied[i] |= bit;
+            for (int c = 0; c < NUM_FU_CLASSES; c++)
+            {
+                iq->fu_class[c][i] &= ~bit;
+            }
+            iq->fu_class[entry->fu_class][i] |= bit;
+            iq->count++;
+
+            // operands not produced yet are delivered by broadcast_result
+            if (entry->num_srcs > 0 && cpu->regs[entry->src1_tag].status == INVALID)
+            {
+                iq->src1_pending[i] |= bit;
+            }
+            if (entry->num_srcs > 1 && cpu->regs[entry->src2_tag].status == INVALID)
+            {
+                iq->src2_pending[i] |= bit;
+            }
+            inst->times.iq_insert = cpu->clock;
+            if (!((iq->src1_pending[i] | iq->src2_pending[i]) & bit))
+            {
+                iq->ready[i] |= bit;
+                inst->times.ready = cpu->clock;
+            }
+            return;
+        }
     }
-    cpu->issue_queue_entry.tail++;
 }
 
 ROB_SLOT create_entry_for_rob(APEX_CPU *cpu, CPU_Stage * inst, int arch_reg){
     ROB_SLOT slot;
     
-    strcpy(slot.opcode_str, inst->opcode_str);
-    strcpy(slot.type, "");
     slot.opcode = inst->opcode;
     slot.slot_id = cpu->rob_queue.tail;
     slot.dest_phy_reg_add = inst->rd;
+    slot.prev_phy_reg = inst->prev_rd;
+    slot.flag_phy_reg = inst->flag_reg;
+    slot.prev_flag_reg = inst->prev_flag_reg;
     slot.arch_reg = arch_reg;
     slot.status = INVALID; // is instruction ready for commit
+    if (inst->fu_class == FU_NONE)
+    {
+        slot.status = VALID; // nothing to execute, e.g. HALT
+    }
     slot.pc = inst->pc;
     slot.calc_mem_add = 0;
     slot.exception_code = 0;
-    strcpy(slot.type,inst->inst_type);
+    slot.branch_mask = inst->branch_mask;
+    slot.seq = inst->seq;
+    slot.times = inst->times;
+    slot.redirected = FALSE;
+    slot.taken = FALSE;
     
     // for STORE instruction and STR instruction
     if(inst->opcode == OPCODE_STR || inst->opcode == OPCODE_STORE){
@@ -561,608 +584,1048 @@ ROB_SLOT create_entry_for_rob(APEX_CPU *cpu, CPU_Stage * inst, int arch_reg){
 
 void add_into_rob(APEX_CPU *cpu, CPU_Stage *inst, int arch_reg)
 {
-    if (is_rob_empty(&cpu->rob_queue))
+    cpu->rob_queue.slots[cpu->rob_queue.tail] = create_entry_for_rob(cpu, inst, arch_reg);
+    cpu->rob_queue.tail = (cpu->rob_queue.tail + 1) % ROB_SIZE;
+}
+
+/* The instruction has produced its result and may commit */
+static void
+complete_rob_entry(APEX_CPU *cpu, int rob_index)
+{
+    cpu->rob_queue.slots[rob_index].status = VALID;
+    cpu->rob_queue.slots[rob_index].times.complete = cpu->clock;
+}
+
+int is_lsq_full(LSQ *lsq)
+{
+    return lsq->count == LSQ_SIZE;
+}
+
+/* Gives a load or store the next LSQ entry, returns its index */
+int add_into_lsq(APEX_CPU *cpu, CPU_Stage *inst)
+{
+    LSQ *lsq = &cpu->lsq;
+    int index = lsq->tail;
+    LSQ_SLOT *entry = &lsq->slots[index];
+
+    memset(entry, 0, sizeof(*entry));
+    entry->pc = inst->pc;
+    entry->seq = inst->seq;
+    entry->rob_index = cpu->rob_queue.tail;
+    entry->is_store = (inst->flags & INSN_IS_STORE) != 0;
+    entry->data_tag = inst->rs1;
+    entry->dest_reg = inst->rd;
+    entry->source_seq = -1;
+    entry->branch_mask = inst->branch_mask;
+    entry->bp_hist = inst->bp_hist;
+    entry->ras = inst->ras;
+    lsq->tail = (lsq->tail + 1) % LSQ_SIZE;
+    lsq->count++;
+    return index;
+}
+
+/* Drops the LSQ entries younger than a mispredicted branch, they are the
+ * ones at the tail */
+void flush_instruction_from_lsq(APEX_CPU *cpu, unsigned int branch_bit){
+    LSQ *lsq = &cpu->lsq;
+
+    while (lsq->count)
+    {
+        int last = (lsq->tail + LSQ_SIZE - 1) % LSQ_SIZE;
+
+        if (!(lsq->slots[last].branch_mask & branch_bit))
+        {
+            break;
+        }
+        lsq->waiting -= lsq->slots[last].waiting;
+        lsq->tail = last;
+        lsq->count--;
+    }
+}
+
+/* Utility Function to flush instruction from issue queue*/
+
+void flush_instruction_from_issue_queue(APEX_CPU *cpu, unsigned int branch_bit){
+    IQ *iq = &cpu->issue_queue_entry;
+    unsigned long long hit[IQ_WORDS];
+
+    mask_match(iq->branch_mask, IQ_WORDS * 64, (int)branch_bit, hit);
+    for (int i = 0; i < IQ_WORDS; i++)
     {
-        cpu->rob_queue.tail = 0;
-        cpu->rob_queue.head = 0;
-        cpu->rob_queue.slots[0] = create_entry_for_rob(cpu, inst, arch_reg);
+        unsigned long long squashed = hit[i] & iq->occupied[i];
+
+        iq->occupied[i] &= ~squashed;
+        iq->ready[i] &= ~squashed;
+        iq->src1_pending[i] &= ~squashed;
+        iq->src2_pending[i] &= ~squashed;
+        iq->count -= __builtin_popcountll(squashed);
     }
-    else
+}
+
+/* Utility Function to flush instruction from Function Units*/
+
+void flush_instruction_from_function_units(APEX_CPU *cpu, unsigned int branch_bit){
+    for (int u = 0; u < cpu->num_fus; u++)
     {
-        cpu->rob_queue.slots[cpu->rob_queue.tail] = create_entry_for_rob(cpu, inst, arch_reg);
+        for (int i = 0; i < cpu->fu[u].depth; i++)
+        {
+            CPU_Stage *stage = &cpu->fu[u].stage[i];
+
+            if (stage->has_insn && (stage->iq_entry.branch_mask & branch_bit))
+            {
+                stage->has_insn = FALSE;
+            }
+        }
     }
-    cpu->rob_queue.tail++;
 }
 
-/* Utility Function to flush instruction from issue queue*/
+/* Utility Function to flush instruction from ROB*/
 
-void flush_instruction_from_issue_queue(APEX_CPU *cpu, int rob_index){
-    int head_pointer = 0; // head pointer of IQ to
-    while (head_pointer != cpu->issue_queue_entry.tail)
+void flush_instruction_from_rob(APEX_CPU *cpu, unsigned int branch_bit){
+    ROB *rob = &cpu->rob_queue;
+
+    // everything younger than the branch sits contiguously at the tail;
+    // the registers it renamed to go straight back on the free list, a
+    // checkpoint of the list would miss ones freed by commits since
+    while (!is_rob_empty(rob))
     {
-        
-        IQ_SLOT *inst = &cpu->issue_queue_entry.slots[head_pointer];
-        if(inst->bis_index == rob_index){
-            cpu->issue_queue_entry.slots[head_pointer].status = ALLOCATED;//Emptying the slot of Issue Queue
+        int last = (rob->tail + ROB_SIZE - 1) % ROB_SIZE;
+        ROB_SLOT *slot = &rob->slots[last];
+
+        if (!(slot->branch_mask & branch_bit))
+        {
+            break;
         }
-    
-        head_pointer++;
-        inst = &cpu->issue_queue_entry.slots[head_pointer];
-        /* code */
+        if (slot->prev_phy_reg >= 0)
+        {
+            release_to_free_list(&cpu->free_list, slot->dest_phy_reg_add);
+        }
+        if (slot->prev_flag_reg >= 0)
+        {
+            release_to_free_list(&cpu->free_list, slot->flag_phy_reg);
+        }
+        RECORD_EVENT(cpu, SQUASH, slot->seq, slot->pc, 0);
+        cpu->stats.squashed++;
+        rob->tail = last;
     }
-    remove_empty_segments_from_iq(cpu);
-    
 }
 
-/* Utility Function to flush instruction from Function Units*/
+/* A branch resolved as predicted, nothing depends on it any more */
+void release_branch(APEX_CPU *cpu, int branch_id){
+    unsigned int branch_bit = 1u << branch_id;
 
-void flush_instruction_from_function_units(APEX_CPU *cpu, int rob_index){
-    if(cpu->mulfu.iq_entry.bis_index == rob_index){
-        cpu->mulfu.has_insn = FALSE;
-        if(is_instruction_for_jbu1(&cpu->mulfu.iq_entry)){
-            // problem here
-            flush_instruction_from_function_units(cpu, cpu->mulfu.iq_entry.bis_index);
+    mask_clear(cpu->issue_queue_entry.branch_mask, IQ_WORDS * 64, (int)branch_bit);
+    for (int u = 0; u < cpu->num_fus; u++)
+    {
+        for (int i = 0; i < cpu->fu[u].depth; i++)
+        {
+            cpu->fu[u].stage[i].iq_entry.branch_mask &= ~branch_bit;
         }
     }
-    if(cpu->intfu.iq_entry.bis_index == rob_index){
-        cpu->intfu.has_insn = FALSE;   
+    for (int i = cpu->rob_queue.head; i != cpu->rob_queue.tail; i = (i + 1) % ROB_SIZE)
+    {
+        cpu->rob_queue.slots[i].branch_mask &= ~branch_bit;
+    }
+    for (int i = 0, j = cpu->lsq.head; i < cpu->lsq.count; i++, j = (j + 1) % LSQ_SIZE)
+    {
+        cpu->lsq.slots[j].branch_mask &= ~branch_bit;
     }
+    remove_from_bis(&cpu->bis_queue, branch_id);
 }
 
-/* Utility Function to flush instruction from ROB*/
+/* The STALL_* reason decode cannot dispatch an instruction, -1 if it can */
+static int
+dispatch_stall_cause(APEX_CPU *cpu, const APEX_Opcode_Info *info)
+{
+    /* ADD/SUB/CMP need a second register for the zero flag they produce */
+    int regs_needed = ((info->flags & INSN_HAS_DEST) != 0) + ((info->flags & INSN_SETS_ZERO) != 0);
 
-void flush_instruction_from_rob(APEX_CPU *cpu, int rob_index){
-    // flush all the instructions till branch
-    cpu->rob_queue.tail = rob_index + 1;
-    
+    if (is_iq_full(&cpu->issue_queue_entry))
+    {
+        return STALL_IQ_FULL;
+    }
+    if (is_rob_full(&cpu->rob_queue))
+    {
+        return STALL_ROB_FULL;
+    }
+    if (cpu->free_list.count < regs_needed)
+    {
+        return STALL_NO_FREE_REG;
+    }
+    if ((info->flags & INSN_IS_BRANCH) && is_bis_full(&cpu->bis_queue))
+    {
+        return STALL_BIS_FULL;
+    }
+    if ((info->flags & (INSN_IS_LOAD | INSN_IS_STORE)) && is_lsq_full(&cpu->lsq))
+    {
+        return STALL_LSQ_FULL;
+    }
+    return -1;
 }
 
 /*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Renames one instruction and puts it in the IQ and ROB. Instructions of a
+ * bundle go through here oldest first, each seeing the rename table as the
+ * ones ahead of it left it, which is what the intra-bundle dependency
+ * check and bypass does in hardware.
  */
 static void
-decode_stage(APEX_CPU *cpu)
+dispatch_instruction(APEX_CPU *cpu, CPU_Stage *inst)
 {
-    if (cpu->decode.has_insn)
-    {
-        
-        // print_array(cpu->wk_array);
-        /* Read operands from register file based on the instruction type */
-        switch (cpu->decode.opcode)
-        {
-            // reg-to-reg inst
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_CMP:
-            case OPCODE_MUL:
-            case OPCODE_DIV:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_LDR:
-            {
-
-                strcpy(cpu->decode.inst_type, "reg");
-                cpu->decode.rs1 = get_entry_from_rename_table(cpu, cpu->decode.rs1);
-                cpu->decode.rs2 = get_entry_from_rename_table(cpu, cpu->decode.rs2);
-                // printf("rs1 rs2 %d %d \n",cpu->decode.rs1, cpu->decode.rs2);
-                // print_array()
-                break;
-            }
-            
-            // reg-to-literal ist
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_LOAD:
-            {
-                strcpy(cpu->decode.inst_type, "regL");
-                cpu->decode.rs1 = get_entry_from_rename_table(cpu, cpu->decode.rs1);
-                break;
-            }
-            
-            // branch inst
-            case OPCODE_JUMP:
-            case OPCODE_JAL:
-            {
-                strcpy(cpu->decode.inst_type, "branch");
-                cpu->decode.rs1 = get_entry_from_rename_table(cpu, cpu->decode.rs1);
-                break;
-            }
-            
-            // store inst
-            case OPCODE_STR:
-            case OPCODE_STORE:
-            {
-                strcpy(cpu->decode.inst_type, "memory");
-                cpu->decode.rs1 = get_entry_from_rename_table(cpu, cpu->decode.rs1);
-                cpu->decode.rs2 = get_entry_from_rename_table(cpu, cpu->decode.rs2);
-                cpu->decode.rs3 = get_entry_from_rename_table(cpu, cpu->decode.rs3);
-                break;
-            }
-            // branch inst
-            case OPCODE_BNZ:
-            case OPCODE_BZ:
-            {
-                strcpy(cpu->decode.inst_type, "branch");
-                int rob_index = cpu->rob_queue.tail;
-                add_into_bis(&cpu->bis_queue,rob_index);
-            }
-
-            default:
-            {
-                break;
-            }
-        }
+    const APEX_Opcode_Info *info = OPCODE_INFO(inst->opcode);
+    int is_branch = (info->flags & INSN_IS_BRANCH) != 0;
 
+    /* Rename the source registers the instruction reads */
+    if (info->num_srcs > 0)
+    {
+        inst->rs1 = get_entry_from_rename_table(cpu, inst->rs1);
+    }
+    if (info->num_srcs > 1)
+    {
+        inst->rs2 = get_entry_from_rename_table(cpu, inst->rs2);
+    }
+    if (info->num_srcs > 2)
+    {
+        inst->rs3 = get_entry_from_rename_table(cpu, inst->rs3);
+    }
+    if (info->flags & INSN_READS_ZERO)
+    {
+        inst->rs1 = get_entry_from_rename_table(cpu, ZERO_FLAG_REG);
+    }
 
-        
-        // if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
-        // {
-        //     print_stage_content("Decode/RF", &cpu->decode, cpu->decode.has_insn);
-        // }
-        // printf("is_iq_full -> %d \n",is_iq_full(&cpu->issue_queue_entry));
-        // printf("is_rob_full -> %d \n",is_rob_full(&cpu->rob_queue));
-        // printf("is_free_reg_from_RF_available -> %d \n",is_free_reg_from_RF_available(cpu));
-        if(is_iq_full(&cpu->issue_queue_entry) == TRUE || is_rob_full(&cpu->rob_queue) == TRUE || is_free_reg_from_RF_available(cpu) == FALSE){
-            cpu->stop_dispatch = TRUE;
-        }else{
-            int arch_reg = cpu->decode.rd;
-            // creating an entry inside rename table
-            switch(cpu->decode.opcode){
-                case OPCODE_ADDL:
-                case OPCODE_SUBL:
-                case OPCODE_LOAD:
-                case OPCODE_JAL:
-                case OPCODE_ADD:
-                case OPCODE_SUB:
-                case OPCODE_MUL:
-                case OPCODE_CMP:
-                case OPCODE_DIV:
-                case OPCODE_AND:
-                case OPCODE_OR:
-                case OPCODE_XOR:
-                case OPCODE_LDR:
-                case OPCODE_MOVC:
-                {
-                    cpu->decode.rd = get_free_reg_from_RF(cpu);
-                    create_entry_in_rename_table(cpu, arch_reg, cpu->decode.rd);
-                    break;
-                }
-                default:
-                {
-                    break;
-                }
-            }
-            printf("iq tail %d \n", cpu->issue_queue_entry.tail);
-            add_into_iq(cpu, &cpu->decode);
-            add_into_rob(cpu, &cpu->decode, arch_reg);
-            issue_queue_stage(cpu);
-            cpu->decode.has_insn = FALSE;
+    int arch_reg = inst->rd;
+    // creating an entry inside rename table
+    inst->prev_rd = -1;
+    if (inst->flags & INSN_HAS_DEST)
+    {
+        inst->prev_rd = get_entry_from_rename_table(cpu, arch_reg);
+        inst->rd = get_free_reg_from_RF(cpu);
+        create_entry_in_rename_table(cpu, arch_reg, inst->rd);
+    }
+    inst->flag_reg = -1;
+    inst->prev_flag_reg = -1;
+    if (inst->flags & INSN_SETS_ZERO)
+    {
+        inst->prev_flag_reg = get_entry_from_rename_table(cpu, ZERO_FLAG_REG);
+        inst->flag_reg = get_free_reg_from_RF(cpu);
+        create_entry_in_rename_table(cpu, ZERO_FLAG_REG, inst->flag_reg);
+    }
 
-            if (cpu->decode.opcode != OPCODE_HALT)
-            {
-                cpu->fetch.has_insn = TRUE;
-            }
-            else
-            {
-                cpu->decode.opcode = 0;
-            }
-        }
+    /* The instruction depends on every branch still in flight; a
+     * branch then takes an id, whose bit the younger ones will
+     * carry, and checkpoints the state after its own rename */
+    inst->branch_mask = cpu->bis_queue.in_flight;
+    inst->branch_id = -1;
+    if (is_branch)
+    {
+        inst->branch_id = add_into_bis(&cpu->bis_queue, cpu->rob_queue.tail);
+        take_checkpoint(cpu, inst->branch_id);
+        // fetch has run ahead of dispatch, so the RAS is the copy it kept
+        cpu->cpu_store[inst->branch_id].ras = inst->ras;
+    }
+    inst->lsq_index = -1;
+    if (info->flags & (INSN_IS_LOAD | INSN_IS_STORE))
+    {
+        inst->lsq_index = add_into_lsq(cpu, inst);
+    }
+    inst->times.rename = cpu->clock;
+    inst->times.iq_insert = inst->times.ready = inst->times.issue = -1;
+    inst->times.complete = inst->times.commit = -1;
+    if (inst->fu_class != FU_NONE)
+    {
+        add_into_iq(cpu, inst);
     }
     else
     {
-        if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
-            print_stage_content("Decode/RF", &cpu->decode, FALSE);
+        // HALT and NOP never issue, they only need a ROB entry
+        inst->times.iq_insert = inst->times.ready = cpu->clock;
+        inst->times.issue = inst->times.complete = cpu->clock;
     }
+    add_into_rob(cpu, inst, arch_reg);
+    RECORD_EVENT(cpu, DISPATCH, inst->seq, inst->pc, 0);
 }
 
-/* Utility function for issue queue stage */
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Dispatches up to dispatch_width instructions from the decode latch in
+ * program order. The first one that cannot get its resources holds back
+ * itself and everything after it, and the cycle counts as a stall.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+decode_stage(APEX_CPU *cpu)
+{
+    int dispatched = 0;
 
-int is_instruction_for_intfu(IQ_SLOT *iq_entry){
-    // check for integer instr 
-    
-    switch (iq_entry->opcode)
-    {
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        case OPCODE_MOVC:
-        case OPCODE_CMP:
-        case OPCODE_OR:
-        case OPCODE_AND:
-        case OPCODE_XOR:
+    if (cpu->decode_count == 0)
+    {
+        if (TRACE_ON(cpu, TRACE_STAGE) && cpu->simulation_enabled == FALSE)
+            print_stage_content("Decode/RF", &cpu->decode[0], FALSE);
+        return;
+    }
+    while (dispatched < cpu->decode_count && dispatched < cpu->dispatch_width)
+    {
+        CPU_Stage *inst = &cpu->decode[dispatched];
+        int stall = dispatch_stall_cause(cpu, OPCODE_INFO(inst->opcode));
+
+        if (stall >= 0)
         {
-            return TRUE;
+            cpu->stats.dispatch_stalls[stall]++;
+            cpu->profile.entries[get_code_memory_index_from_pc(inst->pc)].dispatch_stalls++;
+            break;
         }
+        dispatch_instruction(cpu, inst);
+        dispatched++;
     }
-    return FALSE;
+    cpu->decode_count -= dispatched;
+    memmove(&cpu->decode[0], &cpu->decode[dispatched], cpu->decode_count * sizeof(CPU_Stage));
 }
-int is_instruction_for_mulfu(IQ_SLOT *iq_entry){
-    // check for multiplication inst
-    switch (iq_entry->opcode)
+
+/* Utility function for issue queue stage */
+
+static const char *const fu_labels[NUM_FU_CLASSES] = {
+    [FU_NONE] = "none",
+#define X(name, label, units, latency, pipelined) [FU_##name] = label,
+    APEX_FU_TABLE(X)
+#undef X
+};
+
+/* FU_* class named label in the options, FU_NONE if there is none */
+int get_fu_class(const char *label){
+    for (int c = FU_NONE + 1; c < NUM_FU_CLASSES; c++)
     {
-        case OPCODE_MUL:
+        if (strcmp(label, fu_labels[c]) == 0)
         {
-            return TRUE;
+            return c;
         }
     }
-    return FALSE;
+    return FU_NONE;
 }
 
-int is_instruction_for_m1(IQ_SLOT *iq_entry){
-    // check for mem instr
-    int result = FALSE;
-    switch (iq_entry->opcode)
+/* Lays the pool out from fu_config, the units of a class in a row and
+ * named after it; FALSE if a class is empty or the pool does not fit */
+int build_function_units(APEX_CPU *cpu){
+    int n = 0;
+
+    for (int c = FU_NONE + 1; c < NUM_FU_CLASSES; c++)
     {
-        case OPCODE_LDR:
-        case OPCODE_STORE:
-        case OPCODE_STR:
-        case OPCODE_LOAD:
+        const FU_CONFIG *config = &cpu->fu_config[c];
+
+        if (config->count < 1 || n + config->count > MAX_FUS || config->latency < 1 ||
+            config->latency > MAX_FU_LATENCY)
         {
-            result = TRUE;
-            break;
+            return FALSE;
         }
-    }
-    return result;
+        for (int i = 0; i < config->count; i++, n++)
+        {
+            FU_UNIT *unit = &cpu->fu[n];
 
+            memset(unit, 0, sizeof(*unit));
+            unit->fu_class = c;
+            unit->depth = !FU_IS_COMPUTE(c) ? 2 : config->pipelined ? config->latency : 1;
+            snprintf(unit->name, sizeof(unit->name), "%s%d", fu_labels[c], i);
+            cpu->stats.unit_names[n] = unit->name;
+        }
+    }
+    cpu->num_fus = n;
+    cpu->stats.num_units = n;
+    return TRUE;
 }
+
 int is_branch_inst(int opcode){
-    // check for jump and branch instr 
-    switch (opcode)
+    return (OPCODE_INFO(opcode)->flags & INSN_IS_BRANCH) != 0;
+}
+
+/* Can the unit start an instruction this cycle, asked after it has run. A
+ * pipelined compute unit takes one per cycle, the rest need their first
+ * latch empty */
+int can_function_unit_accept(const FU_UNIT *unit){
+    int free_latch = FALSE;
+
+    if (!FU_IS_COMPUTE(unit->fu_class))
+    {
+        return !unit->stage[0].has_insn;
+    }
+    for (int i = 0; i < unit->depth; i++)
     {
-        case OPCODE_JUMP:
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_JAL:
+        if (!unit->stage[i].has_insn)
         {
-            return TRUE;
+            free_latch = TRUE;
+        }
+        else if (unit->stage[i].fu_delay == 0)
+        {
+            return FALSE; // issued this cycle
         }
     }
-    return FALSE;
-
+    return free_latch;
 }
 
-int is_instruction_for_jbu1(IQ_SLOT *iq_entry){
-    // check for jump and branch instr 
-    switch (iq_entry->opcode)
+/* Puts an instruction in the first free latch of a unit that accepts it */
+void issue_to_function_unit(FU_UNIT *unit, IQ_SLOT *inst){
+    for (int i = 0; i < unit->depth; i++)
     {
-        case OPCODE_JUMP:
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_JAL:
+        if (!unit->stage[i].has_insn)
         {
-            return TRUE;
+            unit->stage[i].iq_entry = *inst;
+            unit->stage[i].has_insn = TRUE;
+            unit->stage[i].fu_delay = 0;
+            return;
         }
     }
-    return FALSE;
+}
+
+static const char *const select_policies[NUM_SELECT_POLICIES] = {
+#define X(name, option) [SELECT_##name] = option,
+    APEX_SELECT_TABLE(X)
+#undef X
+};
 
+/* SELECT_* policy named option, -1 if there is none */
+int get_select_policy(const char *option){
+    for (int i = 0; i < NUM_SELECT_POLICIES; i++)
+    {
+        if (strcmp(option, select_policies[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
 }
-int are_all_stage_busy(APEX_CPU *cpu){
-    return ( cpu->intfu.has_insn == TRUE &&
-         cpu->mulfu.has_insn == TRUE &&
-         cpu->m1.has_insn == TRUE &&
-         cpu->jbu1.has_insn == TRUE
-        );
+
+const char *get_select_policy_str(int policy){
+    return select_policies[policy];
 }
 
-void remove_empty_segments_from_iq(APEX_CPU *cpu){
-    int i = 0;
-    int j = 0;
-    IQ iq_slots_helper;
-    while(i != IQ_SIZE){
-        if(cpu->issue_queue_entry.slots[i].status == UNALLOCATED){
-            iq_slots_helper.slots[j] = cpu->issue_queue_entry.slots[i];
-            i++;
-            j++;
-        }
+/* Ready IQ entries of its class a unit's port may take, FALSE if none */
+static int
+port_candidates(APEX_CPU *cpu, const FU_UNIT *unit, unsigned long long *candidates)
+{
+    IQ *iq = &cpu->issue_queue_entry;
+    unsigned long long any = 0;
 
-        else{
-            i++;
-        }
+    for (int i = 0; i < IQ_WORDS; i++)
+    {
+        candidates[i] = iq->ready[i] & iq->fu_class[unit->fu_class][i];
+        any |= candidates[i];
     }
-    
-    memcpy(cpu->issue_queue_entry.slots, iq_slots_helper.slots,sizeof(cpu->issue_queue_entry.slots));
-    cpu->issue_queue_entry.tail = j;
-}
-
-int is_instruction_valid_for_issuing(APEX_CPU *cpu, IQ_SLOT *inst){
-    int result = TRUE;
-            
-    switch(inst->opcode){
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_CMP:
-        {
-            if(
-                cpu->regs[inst->src1_tag].status == VALID &&
-                cpu->regs[inst->src2_tag].status == VALID
-            ){
-                inst->src1_val = cpu->regs[inst->src1_tag].value;
-                inst->src2_val = cpu->regs[inst->src2_tag].value;
-                cpu->zero_flag.status = FALSE;
-                result = TRUE;
-            }
-            break;
-        }
+    return any != 0;
+}
 
-        case OPCODE_MUL:
-        case OPCODE_DIV:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_XOR:
-        case OPCODE_LDR:
-        case OPCODE_STR:
+/* The candidate no other candidate is older than */
+static int
+oldest_candidate(const IQ *iq, const unsigned long long *candidates)
+{
+    for (int i = 0; i < IQ_WORDS; i++)
+    {
+        unsigned long long bits = candidates[i];
+        while (bits)
         {
-            if(
-                cpu->regs[inst->src1_tag].status == VALID &&
-                cpu->regs[inst->src2_tag].status == VALID
-            ){
-                inst->src1_val = cpu->regs[inst->src1_tag].value;
-                inst->src2_val = cpu->regs[inst->src2_tag].value;
-                result = TRUE;
+            int slot = i * 64 + __builtin_ctzll(bits);
+            unsigned long long older = 0;
+
+            bits &= bits - 1;
+            for (int w = 0; w < IQ_WORDS; w++)
+            {
+                older |= iq->older[slot][w] & candidates[w];
             }
-            break;
-        }
-        
-        case OPCODE_STORE:
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        case OPCODE_LOAD:
-        case OPCODE_JUMP:
-        case OPCODE_JAL:
-        {
-            if(cpu->regs[inst->src1_tag].status == VALID)
+            if (!older)
             {
-                inst->src1_val = cpu->regs[inst->src1_tag].value;
-                result = TRUE;
+                return slot;
             }
-            break;
         }
-        default:
+    }
+    return -1;
+}
+
+/* The n-th candidate, counting from 0 in slot order */
+static int
+nth_candidate(const unsigned long long *candidates, int n)
+{
+    for (int i = 0; i < IQ_WORDS; i++)
+    {
+        unsigned long long bits = candidates[i];
+        int count = __builtin_popcountll(bits);
+
+        if (n >= count)
         {
-            break;
+            n -= count;
+            continue;
+        }
+        while (n--)
+        {
+            bits &= bits - 1;
         }
+        return i * 64 + __builtin_ctzll(bits);
     }
-    return result;    
+    return -1;
 }
 
-int is_instruction_at_the_head_of_rob(APEX_CPU *cpu, IQ_SLOT *inst){
-    if(inst->pc == cpu->rob_queue.slots[cpu->rob_queue.head].pc && 
-        inst->bis_index == cpu->rob_queue.slots[cpu->rob_queue.head].slot_id
-    ){    	
-        return TRUE;
+/* IQ slot a unit's port takes this cycle by the select policy, -1 for none */
+static int
+select_for_port(APEX_CPU *cpu, const FU_UNIT *unit)
+{
+    unsigned long long candidates[IQ_WORDS];
+    int count = 0;
+
+    if (!port_candidates(cpu, unit, candidates))
+    {
+        return -1;
+    }
+    switch (cpu->select_policy)
+    {
+    case SELECT_OLDEST:
+        return oldest_candidate(&cpu->issue_queue_entry, candidates);
+
+    case SELECT_RANDOM:
+        for (int i = 0; i < IQ_WORDS; i++)
+        {
+            count += __builtin_popcountll(candidates[i]);
+        }
+        cpu->select_rng ^= cpu->select_rng << 13;
+        cpu->select_rng ^= cpu->select_rng >> 7;
+        cpu->select_rng ^= cpu->select_rng << 17;
+        return nth_candidate(candidates, (int)(cpu->select_rng % count));
+
+    default:
+        return nth_candidate(candidates, 0);
     }
-    return FALSE;
 }
+
 void
 issue_queue_stage(APEX_CPU *cpu)
 {
-    int head_pointer = 0; // head pointer of IQ to
-    
-    while (head_pointer != cpu->issue_queue_entry.tail)
+    IQ *iq = &cpu->issue_queue_entry;
+
+    // every unit is a port issuing at most one instruction of its class a
+    // cycle; ready bits are set by broadcast_result, nothing is moved
+    for (int u = 0; u < cpu->num_fus && !is_iq_empty(iq); u++)
     {
-        if(are_all_stage_busy(cpu)){
-            break;
+        FU_UNIT *unit = &cpu->fu[u];
+        int slot;
+
+        if (!can_function_unit_accept(unit) || (slot = select_for_port(cpu, unit)) < 0)
+        {
+            continue;
+        }
+        // branch resolutions only update the SoA copy of the mask
+        iq->slots[slot].branch_mask = (unsigned int)iq->branch_mask[slot];
+        issue_to_function_unit(unit, &iq->slots[slot]);
+        TRACE(cpu, TRACE_EVENT, "issue: pc(%d) %s to %s\n", iq->slots[slot].pc, get_opcode_str(iq->slots[slot].opcode), unit->name);
+        RECORD_EVENT(cpu, ISSUE, iq->slots[slot].seq, iq->slots[slot].pc, iq->slots[slot].fu_class);
+        cpu->rob_queue.slots[iq->slots[slot].rob_index].times.issue = cpu->clock;
+        remove_from_iq(iq, slot);
+    }
+}
+
+/* Result of an INT, MUL or DIV instruction. APEX has no exceptions, a
+ * division by zero gives 0 */
+static int
+compute_result(const IQ_SLOT *inst)
+{
+    int result_buffer = 0;
+
+    switch (inst->opcode)
+    {
+    case OPCODE_ADD:
+    {
+        result_buffer = inst->src1_val + inst->src2_val;
+        break;
+    }
+
+    case OPCODE_ADDL:
+    {
+        result_buffer = inst->src1_val + inst->imm;
+        break;
+    }
+
+    case OPCODE_SUB:
+    case OPCODE_CMP:
+    {
+        result_buffer = inst->src1_val - inst->src2_val;
+        break;
+    }
+
+    case OPCODE_SUBL:
+    {
+        result_buffer = inst->src1_val - inst->imm;
+        break;
+    }
+
+    case OPCODE_AND:
+    {
+        result_buffer = inst->src1_val & inst->src2_val;
+        break;
+    }
+
+    case OPCODE_OR:
+    {
+        result_buffer = inst->src1_val | inst->src2_val;
+        break;
+    }
+
+    case OPCODE_XOR:
+    {
+        result_buffer = inst->src1_val ^ inst->src2_val;
+        break;
+    }
+
+    case OPCODE_MOVC:
+    {
+        result_buffer = inst->imm;
+        break;
+    }
+
+    case OPCODE_MUL:
+    {
+        result_buffer = inst->src1_val * inst->src2_val;
+        break;
+    }
+
+    case OPCODE_DIV:
+    {
+        if (inst->src2_val == -1)
+        {
+            result_buffer = (int)(0u - (unsigned int)inst->src1_val); // INT_MIN / -1 wraps
         }
-        
-        IQ_SLOT *inst = &cpu->issue_queue_entry.slots[head_pointer];
-        // check if all the operands are read out from the RF
-        // printf("is_instruction_valid_for_issuing(cpu) %d \n", is_instruction_valid_for_issuing(cpu, inst));
+        else if (inst->src2_val != 0)
+        {
+            result_buffer = inst->src1_val / inst->src2_val;
+        }
+        break;
+    }
+    }
+    return result_buffer;
+}
 
-        if(is_instruction_valid_for_issuing(cpu, inst) == TRUE){
-            // printf("is_instruction_for_intfu(cpu) %d \n", is_instruction_for_intfu(inst));
+/* Moves every instruction in an INT, MUL or DIV unit a cycle on; each
+ * writes back and wakes up its dependents latency cycles after it issued */
+static void
+compute_unit(APEX_CPU *cpu, FU_UNIT *unit)
+{
+    for (int i = 0; i < unit->depth; i++)
+    {
+        CPU_Stage *stage = &unit->stage[i];
+        IQ_SLOT *inst = &stage->iq_entry;
 
-            if (cpu->intfu.has_insn == FALSE && is_instruction_for_intfu(inst) == TRUE)
-            {
-                cpu->intfu.iq_entry = cpu->issue_queue_entry.slots[head_pointer];
-                cpu->intfu.has_insn = TRUE;
-            }
-            
-            if (cpu->mulfu.has_insn == FALSE && is_instruction_for_mulfu(inst))
-            {
-                cpu->mulfu.iq_entry = cpu->issue_queue_entry.slots[head_pointer];
-                cpu->mulfu.has_insn = TRUE;
-                cpu->mulfu.fu_delay = 0;
-            }
-            
-            if (
-                cpu->m1.has_insn == FALSE &&
-                is_instruction_for_m1(inst) &&
-                is_instruction_at_the_head_of_rob(cpu, &cpu->issue_queue_entry.slots[head_pointer])
-            )
-            {
-                printf("M1 stage is executed");
-                cpu->m1.iq_entry = cpu->issue_queue_entry.slots[head_pointer];
-                cpu->m1.has_insn = TRUE;
-            }
-            
-            if (cpu->jbu1.has_insn == FALSE && cpu->zero_flag.status == TRUE && is_instruction_for_jbu1(inst))
-            {
-                cpu->jbu1.iq_entry = cpu->issue_queue_entry.slots[head_pointer];
-                cpu->jbu1.has_insn = TRUE;
-            }
-            
-            // emptying the slot of iq which was issued to function unit
-            cpu->issue_queue_entry.slots[head_pointer].status = ALLOCATED;
+        if (!stage->has_insn)
+        {
+            continue;
+        }
+        if (++stage->fu_delay == 1)
+        {
+            RECORD_EVENT(cpu, FU_START, inst->seq, inst->pc, unit->fu_class);
+        }
+        if (stage->fu_delay < inst->latency)
+        {
+            continue;
         }
-        head_pointer++;
-        inst = &cpu->issue_queue_entry.slots[head_pointer];
-        /* code */
+
+        int result_buffer = compute_result(inst);
+
+        RECORD_EVENT(cpu, FU_END, inst->seq, inst->pc, unit->fu_class);
+        RECORD_EVENT(cpu, WRITEBACK, inst->seq, inst->pc, 0);
+
+        /* Set the renamed zero flag based on the result buffer */
+        if (inst->flags & INSN_SETS_ZERO)
+        {
+            broadcast_result(cpu, inst->flag_reg, result_buffer == 0);
+        }
+        if (inst->flags & INSN_HAS_DEST)
+        {
+            broadcast_result(cpu, cpu->rob_queue.slots[inst->rob_index].dest_phy_reg_add, result_buffer);
+        }
+        TRACE(cpu, TRACE_EVENT, "%s: pc(%d) result %d\n", unit->name, inst->pc, result_buffer);
+
+        /* this states that the execution of the instruction is completed*/
+        complete_rob_entry(cpu, inst->rob_index);
+        stage->has_insn = FALSE;
+    }
+}
+
+/* A checkpoint is the rename map, a few dozen bytes, so one is taken for
+ * every branch dispatched */
+void take_checkpoint(APEX_CPU *cpu, int checkpoint_info){
+    CHECKPOINT_TABLE *checkpoint = &cpu->cpu_store[checkpoint_info];
+
+    memcpy(checkpoint->rename_table, cpu->rename_table, sizeof(checkpoint->rename_table));
+}
+
+void restore_rename_table(APEX_CPU *cpu, int checkpoint_info){
+    memcpy(cpu->rename_table, cpu->cpu_store[checkpoint_info].rename_table, sizeof(cpu->rename_table));
+}
+
+/* Squashes everything younger than a mispredicted branch and rolls the
+ * rename state back to its checkpoint, the branch's own id is released */
+void flush_the_instructions_followed_branch(APEX_CPU *cpu, IQ_SLOT *branch){
+    unsigned int branch_bit = 1u << branch->branch_id;
+
+    TRACE(cpu, TRACE_EVENT, "squash: younger than pc(%d)\n", branch->pc);
+    cpu->stats.branch_flushes++;
+    cpu->rob_queue.slots[branch->rob_index].redirected = TRUE;
+    flush_instruction_from_issue_queue(cpu, branch_bit);
+    flush_instruction_from_function_units(cpu, branch_bit);
+    flush_instruction_from_rob(cpu, branch_bit);
+    flush_instruction_from_lsq(cpu, branch_bit);
+    restore_rename_table(cpu, branch->branch_id);
+
+    // younger branches were squashed, older ones are still unresolved
+    cpu->bis_queue.in_flight &= branch->branch_mask;
+}
+
+static void
+redirect_fetch(APEX_CPU *cpu, int target_pc)
+{
+    /* Calculate new PC, and send it to fetch unit */
+    cpu->pc = target_pc;
+
+    /* Since we are using reverse callbacks for pipeline stages,
+     * this will prevent the new instruction from being fetched in the current cycle*/
+    cpu->fetch_from_next_cycle = TRUE;
+
+    /* Flush previous stages */
+    for (int i = 0; i < cpu->decode_count; i++)
+    {
+        RECORD_EVENT(cpu, SQUASH, cpu->decode[i].seq, cpu->decode[i].pc, 0);
+        cpu->stats.squashed++;
     }
-    remove_empty_segments_from_iq(cpu);
+    cpu->decode_count = 0;
+
+    /* Make sure fetch stage is enabled to start fetching from new PC */
+    cpu->fetch.has_insn = TRUE;
 }
 
+/*
+ * Checks a branch against what fetch did after it and trains the
+ * predictor. On a mispredict everything younger is squashed, the global
+ * history and the RAS are put back as if fetch had guessed right and
+ * fetch restarts on the correct path; otherwise the branch just gives up
+ * its checkpoint.
+ */
 static void
-intfu(APEX_CPU *cpu)
+resolve_branch(APEX_CPU *cpu, IQ_SLOT *inst, int taken, int target)
 {
-    // print_array(cpu->wk_array);
-    if (cpu->intfu.has_insn)
+    APEX_Bpred *bp = cpu->bpred;
+    int conditional = (inst->flags & INSN_READS_ZERO) != 0;
+
+    if (conditional)
+    {
+        bp->update(bp, inst->pc, inst->bp_hist, taken);
+    }
+    if (taken)
+    {
+        apex_bpred_btb_update(bp, inst->pc, target);
+    }
+    if (taken != inst->pred_taken || (taken && target != inst->pred_target))
     {
-        // printf("rs1 %d, rs2 %d \n", inst->src1_val, inst->src2_val);
-        /* Execute logic based on instruction type */
-        int result_buffer;
-        // printf("opcode -> %d",cpu->intfu.iq_entry.opcode);
-        switch (cpu->intfu.iq_entry.opcode)
+        flush_the_instructions_followed_branch(cpu, inst);
+        apex_bpred_recover(bp, inst->bp_hist, conditional, taken);
+        apex_bpred_ras_restore(bp, &cpu->cpu_store[inst->branch_id].ras);
+        if (inst->opcode == OPCODE_JAL)
         {
-        case OPCODE_ADD:
+            apex_bpred_ras_push(bp, inst->pc + 4);
+        }
+        else if (inst->opcode == OPCODE_JUMP)
         {
-            // printf("rs1 -> %d, rs2 -> %d \n", inst->src1_val , inst->src2_val);
-            result_buffer = cpu->intfu.iq_entry.src1_val + cpu->intfu.iq_entry.src2_val;
-            /* Set the zero flag based on the result buffer */
-            if (result_buffer == 0)
-            {
-                cpu->zero_flag.value = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag.value = FALSE;
-            }
-            cpu->zero_flag.status = TRUE;
-            break;
+            int return_pc;
+
+            apex_bpred_ras_pop(bp, &return_pc);
         }
+        redirect_fetch(cpu, taken ? target : inst->pc + 4);
+    }
+    else
+    {
+        release_branch(cpu, inst->branch_id);
+    }
+}
+
+/* Youngest store older than LSQ entry index known to write its address, -1
+ * if none; stores whose address is still unknown are passed over */
+static int
+lsq_older_store(const LSQ *lsq, int index)
+{
+    int address = lsq->slots[index].address;
 
-        case OPCODE_ADDL:
+    for (int i = index; i != lsq->head;)
+    {
+        i = (i + LSQ_SIZE - 1) % LSQ_SIZE;
+        if (lsq->slots[i].is_store && lsq->slots[i].addr_valid && lsq->slots[i].address == address)
         {
-            result_buffer = cpu->intfu.iq_entry.src1_val + cpu->intfu.iq_entry.imm;
-            break;
+            return i;
         }
+    }
+    return -1;
+}
+
+/* Oldest load younger than the store at index that read the store's address
+ * from further back than the store, -1 if none */
+static int
+lsq_violation(const LSQ *lsq, int index)
+{
+    const LSQ_SLOT *store = &lsq->slots[index];
 
-        case OPCODE_SUB:
+    for (int i = (index + 1) % LSQ_SIZE; i != lsq->tail; i = (i + 1) % LSQ_SIZE)
+    {
+        const LSQ_SLOT *load = &lsq->slots[i];
+
+        if (!load->is_store && load->data_valid && load->address == store->address &&
+            load->source_seq < store->seq)
         {
-            result_buffer = cpu->intfu.iq_entry.src1_val - cpu->intfu.iq_entry.src2_val;
-           /* Set the zero flag based on the result buffer */
-            if (result_buffer == 0)
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Sends a load to the L1D to learn when its value arrives, FALSE while
+ * every MSHR is busy. Without an L1D, or outside memory, it is there now */
+static int
+access_l1d(APEX_CPU *cpu, LSQ_SLOT *load)
+{
+    int outcome;
+
+    load->ready = cpu->clock;
+    if (cpu->l1d && apex_mem_valid(cpu->data_memory, load->address))
+    {
+        outcome = apex_cache_load(cpu->l1d, load->address, cpu->clock, &load->ready);
+        if (outcome == L1D_MSHR_FULL)
+        {
+            cpu->stats.l1d_accesses[outcome] += !load->mshr_full;
+            load->mshr_full = TRUE;
+            return FALSE;
+        }
+        cpu->stats.l1d_accesses[outcome]++;
+        if (outcome != L1D_HIT)
+        {
+            TRACE(cpu, TRACE_EVENT, "l1d: pc(%d) misses address %d until cycle %d\n", load->pc,
+                  load->address, load->ready);
+        }
+    }
+    load->accessed = TRUE;
+    return TRUE;
+}
+
+/* Gives a load its value, forwarded from the youngest older store to its
+ * address or read from memory if there is none; FALSE while that store's
+ * data is not known or the L1D has not delivered */
+static int
+execute_load(APEX_CPU *cpu, int index)
+{
+    LSQ *lsq = &cpu->lsq;
+    LSQ_SLOT *load = &lsq->slots[index];
+    int store = lsq_older_store(lsq, index);
+
+    if (store >= 0 && !lsq->slots[store].data_valid)
+    {
+        return FALSE;
+    }
+    if (store >= 0)
+    {
+        load->data = lsq->slots[store].data;
+        load->source_seq = lsq->slots[store].seq;
+        cpu->stats.store_forwards++;
+    }
+    else
+    {
+        if ((!load->accessed && !access_l1d(cpu, load)) || cpu->clock < load->ready)
+        {
+            return FALSE;
+        }
+        load->data = apex_mem_read(cpu->data_memory, load->address);
+        load->source_seq = -1;
+    }
+    load->data_valid = TRUE;
+    broadcast_result(cpu, load->dest_reg, load->data);
+    RECORD_EVENT(cpu, WRITEBACK, load->seq, load->pc, 0);
+    complete_rob_entry(cpu, load->rob_index);
+    return TRUE;
+}
+
+/* Takes a store's data once it is produced, the store can then commit */
+static int
+capture_store_data(APEX_CPU *cpu, int index)
+{
+    LSQ_SLOT *store = &cpu->lsq.slots[index];
+
+    if (cpu->regs[store->data_tag].status != VALID)
+    {
+        return FALSE;
+    }
+    store->data = cpu->regs[store->data_tag].value;
+    store->data_valid = TRUE;
+    complete_rob_entry(cpu, store->rob_index);
+    return TRUE;
+}
+
+/* Cycles until a waiting LSQ entry gets its data: 0 if one does this
+ * cycle, -1 if none will before something else happens. Checked in the
+ * order execute_load goes through */
+static int
+lsq_idle_cycles(APEX_CPU *cpu)
+{
+    LSQ *lsq = &cpu->lsq;
+    int wait = -1;
+
+    for (int i = 0, j = lsq->head; lsq->waiting && i < lsq->count; i++, j = (j + 1) % LSQ_SIZE)
+    {
+        const LSQ_SLOT *entry = &lsq->slots[j];
+        int store;
+        int at;
+
+        if (!entry->waiting)
+        {
+            continue;
+        }
+        if (entry->is_store)
+        {
+            if (cpu->regs[entry->data_tag].status == VALID)
             {
-                cpu->zero_flag.value = TRUE;
+                return 0;
             }
-            else
+            continue;
+        }
+        store = lsq_older_store(lsq, j);
+        if (store >= 0)
+        {
+            if (lsq->slots[store].data_valid)
             {
-                cpu->zero_flag.value = FALSE;
+                return 0;
             }
-            cpu->zero_flag.status = TRUE;
-            break;
+            continue;
+        }
+        if (!entry->accessed && !entry->mshr_full)
+        {
+            return 0;
+        }
+        // the L1D answers on a given cycle, or frees an MSHR on one
+        at = entry->accessed ? entry->ready : apex_cache_next_fill(cpu->l1d, cpu->clock);
+        if (at <= cpu->clock)
+        {
+            return 0;
         }
+        wait = wait < 0 || at - cpu->clock < wait ? at - cpu->clock : wait;
+    }
+    return wait;
+}
+
+/* Retries the waiting loads and stores, oldest first so a store's data
+ * reaches the loads behind it in the same cycle */
+static void
+lsq_stage(APEX_CPU *cpu)
+{
+    LSQ *lsq = &cpu->lsq;
+
+    for (int i = 0, j = lsq->head; lsq->waiting && i < lsq->count; i++, j = (j + 1) % LSQ_SIZE)
+    {
+        LSQ_SLOT *entry = &lsq->slots[j];
 
-        case OPCODE_SUBL:
+        if (entry->waiting && (entry->is_store ? capture_store_data(cpu, j) : execute_load(cpu, j)))
         {
-            result_buffer = cpu->intfu.iq_entry.src1_val - cpu->intfu.iq_entry.imm;
-            
-            break;
+            entry->waiting = FALSE;
+            lsq->waiting--;
         }
+    }
+}
 
-        case OPCODE_CMP:
-        {
-            result_buffer = cpu->intfu.iq_entry.src1_val - cpu->intfu.iq_entry.src2_val;
+/*
+ * A load read its address before an older store to it was known. The load
+ * and everything younger are squashed: the ROB is walked back from the tail
+ * undoing each rename, and the front end is put back to where fetch was at
+ * the load so that it fetches it again.
+ */
+static void
+replay_load(APEX_CPU *cpu, int index)
+{
+    LSQ_SLOT load = cpu->lsq.slots[index];
+    ROB *rob = &cpu->rob_queue;
+    IQ *iq = &cpu->issue_queue_entry;
 
-            /* Set the zero flag based on the result buffer */
-            if (result_buffer == 0)
-            {
-                cpu->zero_flag.value = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag.value = FALSE;
-            }
-            cpu->zero_flag.status = TRUE;
-            break;
-        }
+    TRACE(cpu, TRACE_EVENT, "replay: pc(%d) read address %d early\n", load.pc, load.address);
+    cpu->stats.load_replays++;
+    while (!is_rob_empty(rob))
+    {
+        int last = (rob->tail + ROB_SIZE - 1) % ROB_SIZE;
+        ROB_SLOT *slot = &rob->slots[last];
 
-        case OPCODE_AND:
+        if (slot->seq < load.seq)
         {
-            result_buffer = cpu->intfu.iq_entry.src1_val & cpu->intfu.iq_entry.src2_val;
             break;
         }
-
-        case OPCODE_OR:
+        if (slot->prev_phy_reg >= 0)
         {
-            result_buffer = cpu->intfu.iq_entry.src1_val | cpu->intfu.iq_entry.src2_val;
-            break;
+            cpu->rename_table[slot->arch_reg] = slot->prev_phy_reg;
+            release_to_free_list(&cpu->free_list, slot->dest_phy_reg_add);
         }
-
-        case OPCODE_XOR:
+        if (slot->prev_flag_reg >= 0)
         {
-            result_buffer = cpu->intfu.iq_entry.src1_val ^ cpu->intfu.iq_entry.src2_val;
-            break;
+            cpu->rename_table[ZERO_FLAG_REG] = slot->prev_flag_reg;
+            release_to_free_list(&cpu->free_list, slot->flag_phy_reg);
         }
-
-        case OPCODE_MOVC:
+        RECORD_EVENT(cpu, SQUASH, slot->seq, slot->pc, 0);
+        cpu->stats.squashed++;
+        rob->tail = last;
+    }
+    cpu->bis_queue.in_flight &= load.branch_mask;
+    for (int slot = 0; slot < IQ_SIZE; slot++)
+    {
+        if ((iq->occupied[slot / 64] >> (slot % 64) & 1) && iq->slots[slot].seq >= load.seq)
         {
-            printf("MOVC \n");
-            result_buffer = cpu->intfu.iq_entry.imm;
-            break;
+            remove_from_iq(iq, slot);
         }
+    }
+    for (int u = 0; u < cpu->num_fus; u++)
+    {
+        for (int i = 0; i < cpu->fu[u].depth; i++)
+        {
+            if (cpu->fu[u].stage[i].iq_entry.seq >= load.seq)
+            {
+                cpu->fu[u].stage[i].has_insn = FALSE;
+            }
         }
-        
-        /* Updating ROB slot of that instruction*/
-        int rob_index = cpu->intfu.iq_entry.rob_index;
-        int dest_phy_reg_add = cpu->rob_queue.slots[rob_index].dest_phy_reg_add;
-        cpu->regs[dest_phy_reg_add].value = result_buffer;
-        cpu->regs[dest_phy_reg_add].status = VALID;
-        printf("buffer %d \n", cpu->intfu.iq_entry.imm);
-        // print_reg_file(cpu);
-        
-        /* this states that the execution of the instruction is completed*/
-        cpu->rob_queue.slots[rob_index].status = TRUE; 
-        cpu->intfu.has_insn = FALSE;
     }
-    else
+    while (cpu->lsq.count && cpu->lsq.slots[(cpu->lsq.tail + LSQ_SIZE - 1) % LSQ_SIZE].seq >= load.seq)
     {
-        // if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
-        //     print_stage_content("Execute", &cpu->execute, FALSE);
+        cpu->lsq.tail = (cpu->lsq.tail + LSQ_SIZE - 1) % LSQ_SIZE;
+        cpu->lsq.waiting -= cpu->lsq.slots[cpu->lsq.tail].waiting;
+        cpu->lsq.count--;
     }
+    apex_bpred_recover(cpu->bpred, load.bp_hist, FALSE, FALSE);
+    apex_bpred_ras_restore(cpu->bpred, &load.ras);
+    redirect_fetch(cpu, load.pc);
 }
 
+/* The prefetcher learns the stride of the load at pc from the address m1
+ * computed, and fills the L1D with the lines it expects next */
 static void
-mulfu(APEX_CPU *cpu)
+prefetch(APEX_CPU *cpu, int pc, int address)
 {
-    // print_array(cpu->wk_array);
-    
-    if (cpu->mulfu.has_insn)
-    {
-        cpu->mulfu.fu_delay++;
-        /*Implementation of logic for mul instruction*/
-        
-        if(cpu->mulfu.fu_delay == 3){
-            cpu->mulfu.has_insn = FALSE;
-            cpu->mulfu.fu_delay = 0;
-            int result_buffer = cpu->mulfu.iq_entry.src1_val * cpu->mulfu.iq_entry.src2_val;
-            // cpu->regs[cpu->mulfu.iq_entry.src1_tag].value = result_buffer;
-            // cpu->regs[cpu->mulfu.iq_entry.src1_tag].status = VALID;
-            
-            /* Updating ROB slot of that instruction*/
-            int rob_index = cpu->mulfu.iq_entry.rob_index;
-            int dest_phy_reg_add = cpu->rob_queue.slots[rob_index].dest_phy_reg_add;
-            cpu->regs[dest_phy_reg_add].value = result_buffer;
-            cpu->regs[dest_phy_reg_add].status = VALID;
-            
-            /* this states that the execution of the instruction is completed*/
-            cpu->rob_queue.slots[rob_index].status = TRUE; 
-        }
-        // if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
-        // {
-        //     print_stage_content("Execute", &cpu->execute, cpu->execute.has_insn);
-        // }
-    }
-    else
+    int targets[MAX_PF_DEGREE];
+    int count = apex_prefetch_observe(cpu->prefetcher, pc, address, targets);
+
+    for (int i = 0; i < count; i++)
     {
-        // if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
-        //     print_stage_content("Execute", &cpu->execute, FALSE);
+        if (apex_mem_valid(cpu->data_memory, targets[i]) &&
+            apex_cache_prefetch(cpu->l1d, targets[i], cpu->clock))
+        {
+            TRACE(cpu, TRACE_EVENT, "prefetch: pc(%d) address %d\n", pc, targets[i]);
+            cpu->stats.prefetches++;
+        }
     }
 }
 
+/* Address generation. A store's address can show that a younger load
+ * already read stale data, which is then replayed */
 static void
-m1(APEX_CPU *cpu)
+m1(APEX_CPU *cpu, FU_UNIT *unit)
 {
-    printf("M1 Stage %d \n",cpu->m1.has_insn);
-    if (cpu->m1.has_insn)
+    if (unit->stage[0].has_insn)
     {
-        // printf("rs1 %d, rs2 %d \n", inst->src1_val, inst->src2_val);
-        /* Execute logic based on instruction type */
-        IQ_SLOT *inst = &cpu->m1.iq_entry;
+        IQ_SLOT *inst = &unit->stage[0].iq_entry;
+        LSQ_SLOT *entry = &cpu->lsq.slots[inst->lsq_index];
         int memory_address;
+
+        RECORD_EVENT(cpu, FU_START, inst->seq, inst->pc, FU_MEM);
         switch (inst->opcode)
         {
 
@@ -1175,264 +1638,243 @@ m1(APEX_CPU *cpu)
 
         case OPCODE_LDR:
         case OPCODE_STR:
+        default:
         {
             memory_address = inst->src1_val + inst->src2_val;
             break;
         }
         }
-        cpu->rob_queue.slots[cpu->m1.iq_entry.rob_index].calc_mem_add = memory_address;
-       
-        // if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
-        // {
-        //     print_stage_content("Execute", &cpu->execute, cpu->execute.has_insn);
-        // }
-        
-        if(cpu->m1.iq_entry.opcode == OPCODE_STR || cpu->m1.iq_entry.opcode == OPCODE_STORE){
-            /* Copy data from execute latch to memory latch*/
-            int src_tag = cpu->rob_queue.slots[cpu->m1.iq_entry.rob_index].src1_tag;
-            if(cpu->regs[src_tag].status == VALID){
-                cpu->m2 = cpu->m1;
-                cpu->m1.has_insn = FALSE;
-            }else{
-                CPU_Stage NOP;
-                NOP.opcode = OPCODE_NOP;
-                cpu->m2 = NOP;
-                cpu->m2.has_insn = TRUE;
+        cpu->rob_queue.slots[inst->rob_index].calc_mem_add = memory_address;
+        // a load on a wrong path may go anywhere, the fault is taken at commit
+        cpu->rob_queue.slots[inst->rob_index].exception_code =
+            apex_mem_valid(cpu->data_memory, memory_address) ? 0 : EXCEPTION_MEMORY_FAULT;
+        entry->address = memory_address;
+        entry->addr_valid = TRUE;
+        if (cpu->prefetcher && !entry->is_store)
+        {
+            prefetch(cpu, inst->pc, memory_address);
+        }
+        TRACE(cpu, TRACE_EVENT, "m1: pc(%d) address %d\n", inst->pc, memory_address);
+
+        unit->stage[1] = unit->stage[0];
+        unit->stage[0].has_insn = FALSE;
+        if (entry->is_store)
+        {
+            int load = lsq_violation(&cpu->lsq, inst->lsq_index);
+
+            if (load >= 0)
+            {
+                replay_load(cpu, load);
             }
-        }else{
-            cpu->m2 = cpu->m1;
-            cpu->m1.has_insn = FALSE;
         }
     }
-    else
-    {
-        // if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
-        //     print_stage_content("Execute", &cpu->m1, FALSE);
-    }
 }
 
-
+/* A load reads, a store takes its data; without data either one waits in
+ * the LSQ and leaves the pipe to the instructions behind it */
 static void
-m2(APEX_CPU *cpu)
+m2(APEX_CPU *cpu, FU_UNIT *unit)
 {
-    // print_array(cpu->wk_array);
-    if (cpu->m2.has_insn)
+    if (unit->stage[1].has_insn)
     {
-        // printf("rs1 %d, rs2 %d \n", inst->src1_val, inst->src2_val);
-        /* Execute logic based on instruction type */
-        
-        int memory_address = cpu->rob_queue.slots[cpu->m2.iq_entry.rob_index].calc_mem_add;
-        int dest_phy_reg_add = cpu->rob_queue.slots[cpu->m2.iq_entry.rob_index].dest_phy_reg_add;
-        int src1_tag = cpu->rob_queue.slots[cpu->m2.iq_entry.rob_index].src1_tag;
-        switch (cpu->m2.iq_entry.opcode)
-        {
+        IQ_SLOT *inst = &unit->stage[1].iq_entry;
+        LSQ_SLOT *entry = &cpu->lsq.slots[inst->lsq_index];
 
-        case OPCODE_LOAD:
-        case OPCODE_LDR:
-        {
-            cpu->regs[dest_phy_reg_add].value = cpu->data_memory[memory_address];
-            cpu->regs[dest_phy_reg_add].status = VALID;
-            break;
-        }
-
-        case OPCODE_STORE:
-        case OPCODE_STR:
+        RECORD_EVENT(cpu, FU_END, inst->seq, inst->pc, FU_MEM);
+        if (entry->is_store ? !capture_store_data(cpu, inst->lsq_index)
+                            : !execute_load(cpu, inst->lsq_index))
         {
-            if(cpu->regs[src1_tag].status == VALID){
-                cpu->data_memory[memory_address] = cpu->regs[src1_tag].value;
-                
-            }
-            break;
+            entry->waiting = TRUE;
+            cpu->lsq.waiting++;
         }
-        }
-        
-        /* Updating ROB slot of that instruction*/
-        int rob_index = cpu->m2.iq_entry.rob_index;
-        /* this states that the execution of the instruction is completed*/
-        cpu->rob_queue.slots[rob_index].status = TRUE; 
-        
-        cpu->m2.has_insn = FALSE;
-        // if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
-        // {
-        //     print_stage_content("Execute", &cpu->m2, cpu->execute.has_insn);
-        // }
+        unit->stage[1].has_insn = FALSE;
     }
-    else
-    {
-        // if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
-        //     print_stage_content("Execute", &cpu->execute, FALSE);
-    }
-}
-
-void restore_rename_table(APEX_CPU *cpu, int checkpoint_info){
-    memcpy(cpu->rename_table, cpu->cpu_store[checkpoint_info].rename_table, sizeof(cpu->rename_table));
-}
-
-void restore_regs_file(APEX_CPU *cpu, int checkpoint_info){
-    memcpy(cpu->regs, cpu->cpu_store[checkpoint_info].regs , sizeof(cpu->regs));
-}
-
-void flush_the_instructions_followed_branch(APEX_CPU *cpu, int rob_index, int checkpoint_info){
-    flush_instruction_from_issue_queue(cpu,rob_index);
-    flush_instruction_from_function_units(cpu,rob_index);
-    flush_instruction_from_rob(cpu,rob_index);
-    restore_rename_table(cpu, checkpoint_info);
-    restore_regs_file(cpu, checkpoint_info);
 }
 
 static void
-jbu1(APEX_CPU *cpu)
+jbu1(APEX_CPU *cpu, FU_UNIT *unit)
 {
-    if (cpu->jbu1.has_insn == TRUE)
+    if (unit->stage[0].has_insn == TRUE)
     {
-        /* code */
-        switch(cpu->jbu1.iq_entry.opcode){
-    
+        IQ_SLOT *inst = &unit->stage[0].iq_entry;
+
+        RECORD_EVENT(cpu, FU_START, inst->seq, inst->pc, FU_JBU);
+        switch(inst->opcode){
+
           case OPCODE_BZ:
-          {
-              int rob_index = cpu->jbu1.iq_entry.bis_index;
-              if(cpu->zero_flag.value == TRUE){
-                cpu->is_branch_taken = TRUE;   
-                flush_the_instructions_followed_branch(cpu, rob_index, cpu->jbu1.iq_entry.checkpoint_info);
-                 /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->pc + cpu->jbu1.iq_entry.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                
-              }
-              else{
-                cpu->is_branch_taken = FALSE;    
-                    
-              }
-            break;
-          }
-                       
-          
           case OPCODE_BNZ:
           {
-              int rob_index = cpu->jbu1.iq_entry.bis_index;
-              if(cpu->zero_flag.value == FALSE){
-                flush_the_instructions_followed_branch(cpu, rob_index, cpu->jbu1.iq_entry.checkpoint_info);
-                 /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->pc + cpu->jbu1.iq_entry.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-            break;
+              int taken = (inst->opcode == OPCODE_BZ) == (inst->src1_val != FALSE);
+
+              complete_rob_entry(cpu, inst->rob_index);
+              cpu->rob_queue.slots[inst->rob_index].taken = taken;
+              RECORD_EVENT(cpu, FU_END, inst->seq, inst->pc, FU_JBU);
+              resolve_branch(cpu, inst, taken, inst->pc + inst->imm);
+              unit->stage[0].has_insn = FALSE;
+              break;
           }
-                
-          
-          
+
           case OPCODE_JAL:
           {
-              cpu->jbu1.memory_address = cpu->jbu1.iq_entry.src1_val + cpu->jbu1.iq_entry.imm;
-              int rob_index = cpu->jbu1.iq_entry.rob_index;
-              int dest_phy_reg_add = cpu->rob_queue.slots[rob_index].dest_phy_reg_add;
-              cpu->regs[dest_phy_reg_add].value = cpu->pc + 4;
-              cpu->is_jal_active.status = TRUE;
-              cpu->is_jal_active.reg_index = dest_phy_reg_add;
-              cpu->jbu2 = cpu->jbu1;
-              cpu->jbu1.has_insn = FALSE;
+              unit->stage[0].memory_address = inst->src1_val + inst->imm;
+              int dest_phy_reg_add = cpu->rob_queue.slots[inst->rob_index].dest_phy_reg_add;
+              broadcast_result(cpu, dest_phy_reg_add, inst->pc + 4);
+              RECORD_EVENT(cpu, WRITEBACK, inst->seq, inst->pc, 0);
+              unit->stage[1] = unit->stage[0];
+              unit->stage[0].has_insn = FALSE;
               break;
           }
-          
-          
+
           case OPCODE_JUMP:
             {
-              cpu->jbu1.memory_address = cpu->jbu1.iq_entry.src1_val + cpu->jbu1.iq_entry.imm;
-              cpu->jbu2 = cpu->jbu1;
-              cpu->jbu1.has_insn = FALSE;
+              unit->stage[0].memory_address = inst->src1_val + inst->imm;
+              unit->stage[1] = unit->stage[0];
+              unit->stage[0].has_insn = FALSE;
               break;
             }
-            
+
         }
     }
-    
+
 }
+
+/* JAL and JUMP are always taken, fetch only got them right if the BTB
+ * sent it to the register target */
 static void
-jbu2(APEX_CPU *cpu)
+jbu2(APEX_CPU *cpu, FU_UNIT *unit)
 {
-    if (cpu->jbu1.has_insn == TRUE){
-        switch(cpu->jbu2.iq_entry.opcode){
-            case OPCODE_JAL:
-            {
-                int rob_index = cpu->jbu2.iq_entry.bis_index;
-                flush_the_instructions_followed_branch(cpu, rob_index, cpu->jbu2.iq_entry.checkpoint_info);
-                    /* Calculate new PC, and send it to fetch unit */
-                        cpu->pc = cpu->jbu2.memory_address;
-                        
-                        /* Since we are using reverse callbacks for pipeline stages, 
-                        * this will prevent the new instruction from being fetched in the current cycle*/
-                        cpu->fetch_from_next_cycle = TRUE;
-
-                        /* Flush previous stages */
-                        cpu->decode.has_insn = FALSE;
-
-                        /* Make sure fetch stage is enabled to start fetching from new PC */
-                        cpu->fetch.has_insn = TRUE;
-                
-                break; 
-            } 
-            case OPCODE_JUMP:
-            {
-                int rob_index = cpu->jbu2.iq_entry.bis_index;
-                flush_the_instructions_followed_branch(cpu, rob_index, cpu->jbu2.iq_entry.checkpoint_info);
-                    /* Calculate new PC, and send it to fetch unit */
-                        cpu->pc = cpu->jbu2.memory_address;
-                        
-                        /* Since we are using reverse callbacks for pipeline stages, 
-                        * this will prevent the new instruction from being fetched in the current cycle*/
-                        cpu->fetch_from_next_cycle = TRUE;
-
-                        /* Flush previous stages */
-                        cpu->decode.has_insn = FALSE;
-
-                        /* Make sure fetch stage is enabled to start fetching from new PC */
-                        cpu->fetch.has_insn = TRUE;
-                
-                break;
-            }
-        }  
+    if (unit->stage[1].has_insn == TRUE){
+        IQ_SLOT *inst = &unit->stage[1].iq_entry;
+
+        complete_rob_entry(cpu, inst->rob_index);
+        cpu->rob_queue.slots[inst->rob_index].taken = TRUE;
+        RECORD_EVENT(cpu, FU_END, inst->seq, inst->pc, FU_JBU);
+        resolve_branch(cpu, inst, TRUE, unit->stage[1].memory_address);
+        unit->stage[1].has_insn = FALSE;
+    }
+}
+
+/* Charges a committing instruction's waits to its line of the program. It
+ * has been the ROB head since the previous commit, or since its dispatch
+ * if the ROB was empty, and could commit in none of those cycles. */
+static void
+profile_commit(APEX_CPU *cpu, const ROB_SLOT *slot)
+{
+    APEX_Profile *profile = &cpu->profile;
+    APEX_Profile_Entry *entry = &profile->entries[get_code_memory_index_from_pc(slot->pc)];
+    int head_since = slot->times.rename > profile->last_commit ? slot->times.rename : profile->last_commit;
 
+    entry->commits++;
+    if (slot->times.commit > head_since) // not the second of a wide commit
+    {
+        entry->head_cycles += slot->times.commit - head_since - 1;
     }
+    entry->iq_cycles += slot->times.issue - slot->times.iq_insert;
+    entry->taken += slot->taken;
+    entry->redirects += slot->redirected;
+    profile->last_commit = slot->times.commit;
 }
 
+/* Retires up to commit_width completed instructions from the ROB head, in
+ * order; TRUE once HALT commits */
 static int
 rob(APEX_CPU *cpu)
 {
-    if(cpu->rob_queue.tail >= 0){
-        
-        ROB_SLOT *rob_head = &cpu->rob_queue.slots[cpu->rob_queue.tail];
-        if(rob_head->status == VALID){
-            if(rob_head->dest_phy_reg_add != cpu->rename_table[rob_head->arch_reg]){
-                cpu->regs[rob_head->dest_phy_reg_add].is_free = TRUE;                
-            }
+    for (int n = 0; n < cpu->commit_width && !is_rob_empty(&cpu->rob_queue); n++){
+
+        ROB_SLOT *rob_head = &cpu->rob_queue.slots[cpu->rob_queue.head];
+        if(rob_head->status != VALID){
+            break;
+        }
+        if (rob_head->exception_code == EXCEPTION_MEMORY_FAULT)
+        {
+            // precise: the access and everything after it never happened
+            apex_printf("APEX_CPU: Memory fault at pc(%d), address %d is outside data memory of %d words\n",
+                        rob_head->pc, rob_head->calc_mem_add, cpu->data_memory->size);
+            return TRUE;
+        }
+        rob_head->times.commit = cpu->clock;
+        profile_commit(cpu, rob_head);
+        if (cpu->lifetimes)
+        {
+            apex_trace_lifetime(cpu->lifetimes, rob_head);
+        }
+        if(rob_head->opcode == OPCODE_HALT){
+            RECORD_EVENT(cpu, COMMIT, rob_head->seq, rob_head->pc, 0);
+            return TRUE;
+        }
+        if(rob_head->prev_phy_reg >= 0){
+            // the replaced mapping can have no readers left once its successor retires
+            release_to_free_list(&cpu->free_list, rob_head->prev_phy_reg);
             create_entry_in_backend_rename_table(cpu,rob_head->arch_reg,rob_head->dest_phy_reg_add);
-            
-            cpu->rob_queue.head++;
-            cpu->insn_completed++;
+        }
+        if(rob_head->prev_flag_reg >= 0){
+            release_to_free_list(&cpu->free_list, rob_head->prev_flag_reg);
+            create_entry_in_backend_rename_table(cpu,ZERO_FLAG_REG,rob_head->flag_phy_reg);
+            cpu->zero_flag.value = cpu->regs[rob_head->flag_phy_reg].value;
+        }
+        if (OPCODE_INFO(rob_head->opcode)->flags & (INSN_IS_LOAD | INSN_IS_STORE))
+        {
+            // stores reach memory only here, so a squash never has to undo one
+            LSQ_SLOT *entry = &cpu->lsq.slots[cpu->lsq.head];
+
+            if (entry->is_store)
+            {
+                if (!apex_mem_write(cpu->data_memory, entry->address, entry->data))
+                {
+                    fprintf(stderr, "APEX_Error: Unable to allocate data memory for address %d\n",
+                            entry->address);
+                    exit(1);
+                }
+                cpu->stats.page_faults = cpu->data_memory->pages;
+                if (cpu->l1d)
+                {
+                    cpu->stats.l1d_accesses[apex_cache_store(cpu->l1d, entry->address)]++;
+                }
+            }
+            cpu->lsq.head = (cpu->lsq.head + 1) % LSQ_SIZE;
+            cpu->lsq.count--;
+        }
 
+        cpu->rob_queue.head = (cpu->rob_queue.head + 1) % ROB_SIZE;
+        cpu->insn_completed++;
+        cpu->stats.instructions++;
+        if (OPCODE_INFO(rob_head->opcode)->flags & INSN_IS_BRANCH)
+        {
+            cpu->stats.branches++;
+            cpu->stats.mispredicts += rob_head->redirected;
         }
+        TRACE(cpu, TRACE_EVENT, "commit: pc(%d) %s\n", rob_head->pc, get_opcode_str(rob_head->opcode));
+        RECORD_EVENT(cpu, COMMIT, rob_head->seq, rob_head->pc, 0);
     }
     return 0;
 }
 
+/* Lists the loaded program, printed by main once the trace level is known */
+void
+print_code_memory(const APEX_CPU *cpu)
+{
+    if (!TRACE_ON(cpu, TRACE_STAGE))
+    {
+        return;
+    }
+    fprintf(stderr,
+            "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
+            cpu->code_memory_size);
+    fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
+    fprintf(stderr, "APEX_CPU: IQ tag match using %s kernels\n", apex_simd_name());
+    fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
+    apex_printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
+           "imm");
+
+    for (int i = 0; i < cpu->code_memory_size; ++i)
+    {
+        apex_printf("%-9s %-9d %-9d %-9d %-9d\n", get_opcode_str(cpu->code_memory[i].opcode),
+               cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
+               cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+    }
+}
+
 /*
  * This function creates and initializes APEX cpu.
  *
@@ -1441,7 +1883,6 @@ rob(APEX_CPU *cpu)
 APEX_CPU *
 APEX_cpu_init(const char *filename)
 {
-    int i;
     APEX_CPU *cpu;
 
     if (!filename)
@@ -1449,57 +1890,294 @@ APEX_cpu_init(const char *filename)
         return NULL;
     }
 
-    cpu = calloc(1, sizeof(APEX_CPU));
+    // the IQ's SoA arrays are declared 32-byte aligned, calloc only promises 16
+    cpu = aligned_alloc(_Alignof(APEX_CPU), sizeof(APEX_CPU));
 
     if (!cpu)
     {
         return NULL;
     }
+    memset(cpu, 0, sizeof(APEX_CPU));
 
     /* Initialize PC, Registers and all pipeline stages */
+    apex_simd_init();
     cpu->pc = 4000;
     memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
-    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
+    cpu->data_memory = apex_mem_create(DATA_MEMORY_SIZE);
+    if (!cpu->data_memory)
+    {
+        free(cpu);
+        return NULL;
+    }
     cpu->single_step = DISABLE_SINGLE_STEP;
+    cpu->cycle_skip = ENABLE_CYCLE_SKIP;
+    cpu->trace_level = APEX_TRACE_LEVEL;
     cpu->clock = 1;
     cpu->simulation_enabled = FALSE;
     cpu->simulation_cycles = 0;
+    cpu->fetch_width = FETCH_WIDTH;
+    cpu->dispatch_width = DISPATCH_WIDTH;
+    cpu->commit_width = COMMIT_WIDTH;
+#define X(name, label, units, latency, pipelined) \
+    cpu->fu_config[FU_##name] = (FU_CONFIG){units, latency, pipelined};
+    APEX_FU_TABLE(X)
+#undef X
+    build_function_units(cpu);
+    cpu->select_policy = SELECT_DEFAULT;
+    cpu->select_rng = SELECT_SEED;
+    cpu->stats.select_policy = get_select_policy_str(cpu->select_policy);
     /* Parse input file and create code memory */
     cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
     if (!cpu->code_memory)
     {
+        apex_mem_free(cpu->data_memory);
         free(cpu);
         return NULL;
     }
-
-    if (ENABLE_DEBUG_MESSAGES && cpu->simulation_enabled == FALSE)
+    if (!apex_profile_init(&cpu->profile, cpu->code_memory_size))
     {
-        fprintf(stderr,
-                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
-                cpu->code_memory_size);
-        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
-        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
-        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
-               "imm");
-
-        for (i = 0; i < cpu->code_memory_size; ++i)
-        {
-            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
-                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
-                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
-        }
+        free(cpu->code_memory);
+        apex_mem_free(cpu->data_memory);
+        free(cpu);
+        return NULL;
+    }
+    cpu->bpred = apex_bpred_create(APEX_BPRED_DEFAULT, BP_TABLE_BITS, BP_HIST_BITS, BTB_BITS,
+                                   RAS_DEPTH);
+    if (!cpu->bpred)
+    {
+        apex_profile_free(&cpu->profile);
+        free(cpu->code_memory);
+        apex_mem_free(cpu->data_memory);
+        free(cpu);
+        return NULL;
     }
-    /* Initialise wk array */
+    cpu->stats.predictor = cpu->bpred->name;
+
+    /* Architectural register i, and the zero flag after them, starts out
+     * mapped to physical register i, every other physical register is on
+     * the free list */
+    initialize_free_list(&cpu->free_list);
     for (int i = 0; i < REG_FILE_SIZE; i++)
     {
         cpu->regs[i].status = VALID;
-        cpu->regs[i].is_free = TRUE;
+        if (i < RENAME_TABLE_SIZE)
+        {
+            cpu->rename_table[i] = i;
+            cpu->back_end_table[i] = i;
+        }
+        else
+        {
+            release_to_free_list(&cpu->free_list, i);
+        }
     }
+    initialize_rob(&cpu->rob_queue);
+    initialize_bis(&cpu->bis_queue);
     /* To start fetch stage */
     cpu->fetch.has_insn = TRUE;
     return cpu;
 }
 
+/* Would a port find a ready IQ entry for its free unit this cycle */
+static int
+iq_can_issue(APEX_CPU *cpu)
+{
+    for (int u = 0; u < cpu->num_fus; u++)
+    {
+        unsigned long long candidates[IQ_WORDS];
+
+        if (can_function_unit_accept(&cpu->fu[u]) && port_candidates(cpu, &cpu->fu[u], candidates))
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Would decode dispatch, or fetch move anything into decode, this cycle */
+static int
+front_end_can_move(APEX_CPU *cpu)
+{
+    // a stalled decode only counts the stall again
+    if (cpu->decode_count && dispatch_stall_cause(cpu, OPCODE_INFO(cpu->decode[0].opcode)) < 0)
+    {
+        return TRUE;
+    }
+    if (cpu->fetch.has_insn)
+    {
+        int index = get_code_memory_index_from_pc(cpu->pc);
+
+        // a stalled fetch re-reads the same pc, unless that is a HALT
+        if (cpu->fetch_from_next_cycle || cpu->decode_count < cpu->fetch_width ||
+            index < 0 || index >= cpu->code_memory_size ||
+            cpu->code_memory[index].opcode == OPCODE_HALT)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Number of cycles, starting with the current one, in which no stage can
+ * change any state other than the delay counts of the compute units. Zero
+ * when the current cycle does real work, -1 when nothing will ever happen
+ * again. */
+static int
+idle_cycles(APEX_CPU *cpu)
+{
+    ROB *rob = &cpu->rob_queue;
+    int wait = lsq_idle_cycles(cpu);
+
+    if (wait == 0 || (!is_rob_empty(rob) && rob->slots[rob->head].status == VALID))
+    {
+        return 0;
+    }
+    for (int u = 0; u < cpu->num_fus; u++)
+    {
+        FU_UNIT *unit = &cpu->fu[u];
+        CPU_Stage *stage = unit->stage;
+
+        if ((unit->fu_class == FU_JBU || unit->fu_class == FU_MEM) &&
+            (stage[0].has_insn || stage[1].has_insn))
+        {
+            return 0;
+        }
+        if (!FU_IS_COMPUTE(unit->fu_class))
+        {
+            continue;
+        }
+        // a compute instruction records its start in its first cycle and
+        // writes back in its last, in between only its delay count moves
+        for (int i = 0; i < unit->depth; i++)
+        {
+            if (stage[i].has_insn)
+            {
+                int left = stage[i].iq_entry.latency - 1 - stage[i].fu_delay;
+
+                if (stage[i].fu_delay == 0 || left <= 0)
+                {
+                    return 0;
+                }
+                wait = wait < 0 || left < wait ? left : wait;
+            }
+        }
+    }
+    if (iq_can_issue(cpu) || front_end_can_move(cpu))
+    {
+        return 0;
+    }
+    return wait;
+}
+
+/* Charges n cycles of the current state to the counters: the start of a
+ * stepped cycle, or a run of skipped ones in which nothing moves */
+static void
+count_cycles(APEX_CPU *cpu, int n)
+{
+    APEX_Stats *stats = &cpu->stats;
+    ROB *rob = &cpu->rob_queue;
+
+    stats->cycles += n;
+    for (int u = 0; u < cpu->num_fus; u++)
+    {
+        for (int i = 0; i < cpu->fu[u].depth; i++)
+        {
+            if (cpu->fu[u].stage[i].has_insn)
+            {
+                stats->unit_busy[u] += n;
+                break;
+            }
+        }
+    }
+    stats->iq_occupancy[cpu->issue_queue_entry.count] += n;
+    stats->rob_occupancy[(rob->tail - rob->head + ROB_SIZE) % ROB_SIZE] += n;
+}
+
+/* Display mode traces every cycle, simulate mode only the ones from the
+ * cycle limit on */
+static int
+cycle_is_traced(APEX_CPU *cpu, int clock)
+{
+    return TRACE_ON(cpu, TRACE_STAGE) &&
+           (cpu->simulation_enabled == FALSE || clock >= cpu->simulation_cycles);
+}
+
+/* Advances the clock over idle cycles as if they had been stepped. Only
+ * cycles that print nothing are skipped, so the output is unchanged. */
+static void
+skip_idle_cycles(APEX_CPU *cpu)
+{
+    int skip;
+
+    if (!cpu->cycle_skip || !cpu->simulation_enabled || cpu->single_step ||
+        cycle_is_traced(cpu, cpu->clock) || TRACE_ON(cpu, TRACE_EVENT))
+    {
+        return;
+    }
+    skip = idle_cycles(cpu);
+    if (cpu->simulation_cycles && (skip < 0 || skip > cpu->simulation_cycles - cpu->clock))
+    {
+        // stop at the cycle limit, or at the first cycle that prints
+        skip = cpu->simulation_cycles - cpu->clock;
+    }
+    if (skip <= 0)
+    {
+        return; // this cycle does work, or nothing will ever happen and there is no limit
+    }
+    count_cycles(cpu, skip);
+    if (cpu->decode_count)
+    {
+        // decode stalled in every one of them for the same reason
+        cpu->stats.dispatch_stalls[dispatch_stall_cause(cpu, OPCODE_INFO(cpu->decode[0].opcode))] += skip;
+        cpu->profile.entries[get_code_memory_index_from_pc(cpu->decode[0].pc)].dispatch_stalls += skip;
+    }
+    for (int u = 0; u < cpu->num_fus; u++)
+    {
+        for (int i = 0; FU_IS_COMPUTE(cpu->fu[u].fu_class) && i < cpu->fu[u].depth; i++)
+        {
+            if (cpu->fu[u].stage[i].has_insn)
+            {
+                cpu->fu[u].stage[i].fu_delay += skip;
+            }
+        }
+    }
+    cpu->clock += skip;
+}
+
+/* Runs every unit of the pool for a cycle: the memory pipes, then the
+ * branch pipes, each back stage first, then the compute units */
+static void
+function_units(APEX_CPU *cpu)
+{
+    static const int order[] = {FU_MEM, FU_JBU, FU_DIV, FU_MUL, FU_INT};
+
+    for (int k = 0; k < (int)(sizeof(order) / sizeof(order[0])); k++)
+    {
+        for (int u = 0; u < cpu->num_fus; u++)
+        {
+            FU_UNIT *unit = &cpu->fu[u];
+
+            if (unit->fu_class != order[k])
+            {
+                continue;
+            }
+            if (unit->fu_class == FU_MEM)
+            {
+                m2(cpu, unit);
+                m1(cpu, unit);
+            }
+            else if (unit->fu_class == FU_JBU)
+            {
+                jbu2(cpu, unit);
+                jbu1(cpu, unit);
+            }
+            else
+            {
+                compute_unit(cpu, unit);
+            }
+        }
+    }
+}
+
 /*
  * APEX CPU simulation loop
  *
@@ -1511,27 +2189,32 @@ void APEX_cpu_run(APEX_CPU *cpu)
 
     while (TRUE)
     {
-        if (ENABLE_DEBUG_MESSAGES && (cpu->simulation_enabled == TRUE && cpu->clock >= cpu->simulation_cycles) || cpu->simulation_enabled == FALSE)
+        if (cpu->simulation_cycles && cpu->clock > cpu->simulation_cycles)
+        {
+            apex_printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock - 1, cpu->insn_completed);
+            break;
+        }
+
+        skip_idle_cycles(cpu);
+        count_cycles(cpu, 1);
+
+        if (cycle_is_traced(cpu, cpu->clock))
         {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock);
-            printf("--------------------------------------------\n");
+            apex_printf("--------------------------------------------\n");
+            apex_printf("Clock Cycle #: %d\n", cpu->clock);
+            apex_printf("--------------------------------------------\n");
         }
 
-        if (rob(cpu) || cpu->clock == 20)
+        if (rob(cpu))
         {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            /* Halt in commit stage */
+            apex_printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
             break;
         }
 
-        rob(cpu);
-        m2(cpu);
-        m1(cpu);
-        jbu2(cpu);
-        jbu1(cpu);
-        mulfu(cpu);
-        intfu(cpu);
+        lsq_stage(cpu);
+        function_units(cpu);
+        issue_queue_stage(cpu);
         decode_stage(cpu);
         APEX_fetch(cpu);
 
@@ -1539,12 +2222,13 @@ void APEX_cpu_run(APEX_CPU *cpu)
         {
             print_reg_file(cpu);
             print_data_mem(cpu);
-            printf("Press any key to advance CPU Clock or <q> to quit:\n");
+            apex_printf("Press any key to advance CPU Clock or <q> to quit:\n");
+            apex_stream_flush(apex_out);
             scanf("%c", &user_prompt_val);
 
             if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
             {
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+                apex_printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
                 break;
             }
         }
@@ -1560,6 +2244,13 @@ void APEX_cpu_run(APEX_CPU *cpu)
  */
 void APEX_cpu_stop(APEX_CPU *cpu)
 {
+    apex_trace_close(cpu->event_trace);
+    apex_trace_close(cpu->lifetimes);
+    apex_profile_free(&cpu->profile);
+    apex_bpred_free(cpu->bpred);
+    apex_cache_free(cpu->l1d);
+    apex_prefetch_free(cpu->prefetcher);
+    apex_mem_free(cpu->data_memory);
     free(cpu->code_memory);
     free(cpu);
 }
\ No newline at end of file
@@ -9,29 +9,78 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
+#include "apex_bpred.h"
+#include "apex_cache.h"
 #include "apex_macros.h"
+#include "apex_mem.h"
+#include "apex_prefetch.h"
+#include "apex_profile.h"
+#include "apex_stats.h"
+
+/* Static facts about an opcode, one entry per line of APEX_OPCODE_TABLE */
+typedef struct APEX_Opcode_Info
+{
+    const char *mnemonic;
+    int format;   /* FMT_* operand layout */
+    int num_srcs; /* rs1/rs2/rs3 fields read, in that order */
+    int fu_class;
+    int latency;
+    int flags;    /* INSN_* bits */
+} APEX_Opcode_Info;
+
+extern const APEX_Opcode_Info opcode_table[NUM_OPCODES];
+extern const int format_operands[NUM_FORMATS][MAX_OPERANDS];
+
+#define OPCODE_INFO(opcode) (&opcode_table[(opcode)])
 
 typedef struct REG_FILE
 {
     char status; // checked if the data is written by the intructions
     int value;
-    int is_free; // checked if the there is any entry of it in Rename table or not
 } REG_FILE;
 
+/* Free physical registers, one bit per register of the unified RF */
+typedef struct FREE_LIST
+{
+    unsigned long long bits[FREE_LIST_WORDS];
+    int count; /* number of set bits */
+} FREE_LIST;
+
+/* Cycle an instruction reached each point of its life, -1 until it does.
+ * Fetch and rename ride in the decode latch, the rest is filled in on the
+ * ROB entry. HALT and NOP never issue, all their post-rename times are the
+ * rename cycle. */
+typedef struct INSN_TIMES
+{
+    int fetch;     /* moved from fetch into the decode latch */
+    int rename;    /* renamed and dispatched */
+    int iq_insert;
+    int ready;     /* last source operand woken up */
+    int issue;
+    int complete;  /* result written, ROB entry VALID */
+    int commit;
+} INSN_TIMES;
+
 typedef struct ROB_SLOT
 {
-    char opcode_str[128];
-    char type[32];
     int opcode;
     int slot_id;
     int dest_phy_reg_add;
+    int prev_phy_reg; /* mapping of arch_reg replaced at rename, freed at commit */
+    int flag_phy_reg; /* register holding the zero flag this instruction sets */
+    int prev_flag_reg; /* zero flag mapping replaced at rename, freed at commit */
     int arch_reg;
     int status;
     int pc;
     int calc_mem_add;
-    int exception_code;
+    int exception_code; /* EXCEPTION_*, 0 for none */
     int src1_ready_bit;
     int src1_tag;
+    unsigned int branch_mask; /* unresolved older branches, one bit per BIS id */
+    int seq; /* fetch order, names the instruction in the event trace */
+    INSN_TIMES times;
+    int redirected; /* squashed what followed it and sent fetch elsewhere */
+    int taken;      /* a control transfer that went to its target */
 } ROB_SLOT;
 
 typedef struct ROB
@@ -41,74 +90,136 @@ typedef struct ROB
     int tail;
 } ROB;
 
-typedef struct JAL_JUMP
-{
-    int status;
-    int reg_index;
-} JAL_JUMP;
-
 typedef struct IQ_SLOT
 {
-    char opcode_str[128];
     int pc;
     int opcode;
-    int status;
+    int fu_class;
+    int latency;
+    int flags;
     int rob_index;
-    int src1_bit;
-    int src2_bit;
+    int num_srcs; /* register operands waited on in the IQ */
     int src1_val;
     int src2_val;
     int src1_tag;
     int src2_tag;
     int imm;
     int dest_reg;
-    int bis_index;
-    int checkpoint_info;
+    int flag_reg; /* physical register the zero flag result goes to */
+    unsigned int branch_mask; /* unresolved older branches, one bit per BIS id */
+    int branch_id; /* BIS id and checkpoint of a branch, -1 otherwise */
+    int pred_taken; /* what fetch did after a branch, checked when it resolves */
+    int pred_target;
+    unsigned long long bp_hist; /* global history the branch was predicted with */
+    int lsq_index; /* LSQ entry of a load or store, -1 otherwise */
+    int seq;
 } IQ_SLOT;
 
+/* Entries never move once inserted; a slot is live while its occupied bit
+ * is set and can be selected once its ready bit is set too. Slot order says
+ * nothing about age, the age matrix does: a row is written when its slot is
+ * filled and the slot's column is cleared in every other row. The fields that
+ * wakeup and squash search are kept as arrays padded to IQ_WORDS * 64 so
+ * the tag_match kernels can compare them a vector at a time. */
 typedef struct IQ
 {
     IQ_SLOT slots[IQ_SIZE];
+    int src1_tag[IQ_WORDS * 64] __attribute__((aligned(32)));
+    int src2_tag[IQ_WORDS * 64] __attribute__((aligned(32)));
+    int branch_mask[IQ_WORDS * 64] __attribute__((aligned(32)));
+    unsigned long long occupied[IQ_WORDS];
+    unsigned long long ready[IQ_WORDS];
+    unsigned long long src1_pending[IQ_WORDS]; /* waiting on src1_tag */
+    unsigned long long src2_pending[IQ_WORDS]; /* waiting on src2_tag */
+    unsigned long long fu_class[NUM_FU_CLASSES][IQ_WORDS]; /* slots steered to each class */
+    unsigned long long older[IQ_SIZE][IQ_WORDS]; /* age matrix, row s: slots inserted before s */
+    int count;
+} IQ;
+
+/* Loads and stores in program order, allocated at dispatch. A store keeps
+ * its address and data here until it writes memory at commit; a load takes
+ * its value from the youngest older store to its address, or from memory.
+ * Stores whose address is not known yet are assumed to go elsewhere, the
+ * store checks the younger loads when its address turns up. */
+typedef struct LSQ_SLOT
+{
+    int pc;
+    int seq;
+    int rob_index;
+    int is_store;
+    int addr_valid;
+    int address;
+    int data_valid; /* store data captured, or load value read */
+    int data;
+    int data_tag;   /* store: physical register holding the data */
+    int dest_reg;   /* load: physical register the value goes to */
+    int waiting;    /* left the pipe without its data, retried every cycle */
+    int source_seq; /* load: store it forwarded from, -1 for memory */
+    int accessed;   /* load: went to the L1D, its value arrives in cycle ready */
+    int ready;
+    int mshr_full;  /* load: found every MSHR busy */
+    unsigned int branch_mask;
+    unsigned long long bp_hist; /* load: predictor state fetch saw, put back on replay */
+    RAS_SNAPSHOT ras;
+} LSQ_SLOT;
+
+typedef struct LSQ
+{
+    LSQ_SLOT slots[LSQ_SIZE];
     int head;
     int tail;
-} IQ;
+    int count;
+    int waiting; /* entries with waiting set */
+} LSQ;
 
+/* Only the rename map and the return address stack are saved. Register
+ * values are never rolled back: a squashed destination goes back on the
+ * free list when its ROB entry is dropped, and whatever older instructions
+ * wrote stays valid */
 typedef struct CHECKPOINT_TABLE
 {
-    int rename_table[R_TABLE_SIZE];
-    REG_FILE regs[REG_FILE_SIZE];
-    int is_free;
+    int rename_table[RENAME_TABLE_SIZE];
+    RAS_SNAPSHOT ras; /* return address stack before fetch saw the branch */
 } CHECKPOINT_TABLE;
-/*Format of a BIS table*/
 
+/*Format of a BIS table: a branch is given a free id at dispatch, which is
+ * the bit it sets in the branch_mask of every younger instruction and the
+ * index of its checkpoint in cpu_store */
 typedef struct BIS{
-     int slots[BIS_SIZE];
-     int head;
-     int tail;
+     int rob_index[BIS_SIZE];
+     unsigned int in_flight; /* ids of unresolved branches */
 } BIS;
 
+/* Predecoded instruction, built once by create_code_memory. Mnemonics are
+ * looked up with get_opcode_str only when printing. */
 typedef struct APEX_Instruction
 {
-    char opcode_str[128];
     int opcode;
     int rd;
     int rs1;
     int rs2;
     int rs3;
     int imm;
+    int fu_class; /* FU_* class the instruction issues to */
+    int latency;  /* execute cycles in its functional unit */
+    int flags;    /* INSN_* bits */
 } APEX_Instruction;
 
 /* Model of CPU stage latch */
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
-    char inst_type[24];
     int opcode;
+    int fu_class;
+    int latency;
+    int flags;
     int rs1;
     int rs2;
     int rs3;
     int rd;
+    int prev_rd; /* physical register rd was mapped to before rename */
+    int flag_reg; /* physical register renamed for the zero flag */
+    int prev_flag_reg;
     int imm;
     int rs1_value;
     int rs2_value;
@@ -116,13 +227,41 @@ typedef struct CPU_Stage
     int result_buffer;
     int memory_address;
     int has_insn;
-    int checkpoint_info;
-    int fu_delay; // used for mul fu unit
+    int seq; /* fetch order, assigned when the instruction leaves fetch */
+    INSN_TIMES times;
+    unsigned int branch_mask; /* unresolved older branches, set at dispatch */
+    int branch_id;
+    int pred_taken; /* set by fetch for branches */
+    int pred_target;
+    unsigned long long bp_hist;
+    RAS_SNAPSHOT ras; /* carried to dispatch for the branch's checkpoint */
+    int lsq_index;
+    int fu_delay; // cycles spent in the function unit so far
     IQ_SLOT iq_entry; // used to access the iq entry issued from iq inside the stages
 } CPU_Stage;
+
+/* How many units of a class there are, the cycles an instruction spends in
+ * one and whether it takes a new instruction every cycle */
+typedef struct FU_CONFIG
+{
+    int count;
+    int latency;
+    int pipelined;
+} FU_CONFIG;
+
+/* One unit of the pool, also its issue port. A compute unit keeps the
+ * instructions in flight in its latches, each counting its own fu_delay: up
+ * to latency of them when pipelined, one otherwise. MEM and JBU units use
+ * stage[0] and stage[1] as m1/m2 and jbu1/jbu2. */
+typedef struct FU_UNIT
+{
+    int fu_class;
+    int depth; /* latches in use */
+    char name[8];
+    CPU_Stage stage[MAX_FU_LATENCY];
+} FU_UNIT;
 typedef struct zero_flag{
-    int value;
-    int status;
+    int value; /* committed value, the in-flight ones live in the renamed registers */
 }zero_flag;
 /* Model of APEX CPU */
 typedef struct APEX_CPU
@@ -131,40 +270,57 @@ typedef struct APEX_CPU
     int clock;                     /* Clock cycles elapsed */
     int insn_completed;            /* Instructions retired */
     int code_memory_size;          /* Number of instruction in the input file */
-    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
+    APEX_Memory *data_memory;      /* Data Memory */
     int single_step;               /* Wait for user input after every cycle */
+    int cycle_skip;                /* Jump over cycles where nothing but timers change */
+    int trace_level;               /* TRACE_* messages up to this level are printed */
+    struct APEX_Trace *event_trace; /* binary event trace, NULL when off */
+    struct APEX_Trace *lifetimes;   /* INSN_TIMES of each commit, NULL when off */
+    int next_seq;
+    APEX_Stats stats;              /* performance counters */
+    APEX_Profile profile;          /* the same, per line of the program */
+    const char *stats_file;        /* JSON dump of stats, NULL when off */
+    const char *profile_file;      /* annotated listing, NULL when off */
+    const char *mem_dump_file;     /* final data memory image, NULL when off */
+    APEX_Bpred *bpred;             /* direction predictor and BTB used by fetch */
+    APEX_Cache *l1d;               /* NULL without --l1d, memory then answers in a cycle */
+    APEX_Prefetcher *prefetcher;   /* NULL without --prefetch, fills the L1D */
     zero_flag zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int fetch_from_next_cycle;
-    int is_branch_taken;                 /* {TRUE, FALSE} Used by BZ and BNZ when branch is taken */
     int simulation_enabled;
     int simulation_cycles;
-    int stop_dispatch; // to stop the dispatching into the issue queue when IQ is full or ROB is full
-    int rename_table[R_TABLE_SIZE];     /*  Rename Table  */
-    int back_end_table[R_TABLE_SIZE]; /*Backend Rename Table */
+    int fetch_width;               /* instructions fetched per cycle */
+    int dispatch_width;            /* renamed and dispatched per cycle */
+    int commit_width;              /* retired per cycle */
+    int rename_table[RENAME_TABLE_SIZE];     /*  Rename Table  */
+    int back_end_table[RENAME_TABLE_SIZE]; /*Backend Rename Table */
     
     REG_FILE regs[REG_FILE_SIZE];       /* Unified register file */
+    FREE_LIST free_list;                /* Free physical registers */
     APEX_Instruction *code_memory; /* Code Memory */
     IQ issue_queue_entry; /* Issue queue */
     ROB rob_queue; /* ROB queue */
+    LSQ lsq;       /* load/store queue */
     BIS bis_queue;
-    JAL_JUMP is_jal_active;
     CHECKPOINT_TABLE cpu_store[BIS_SIZE]; // to store the checkpoints
     /* Pipeline stages */
     CPU_Stage fetch;
-    CPU_Stage decode;
+    CPU_Stage decode[MAX_WIDTH]; /* fetched bundle, oldest first, waiting to dispatch */
+    int decode_count;
     CPU_Stage issue_queue_stage;
-    CPU_Stage intfu; // kamal is handling
-    CPU_Stage mulfu; // sandesh handling
-    CPU_Stage jbu1; // sandesh handling
-    CPU_Stage jbu2; // sandesh handling
-    CPU_Stage m1;
-    CPU_Stage m2;
+    FU_CONFIG fu_config[NUM_FU_CLASSES]; /* pool layout, indexed by FU_* */
+    FU_UNIT fu[MAX_FUS];                 /* the pool, units of a class next to each other */
+    int num_fus;
+    int select_policy;                   /* SELECT_* used by every port */
+    unsigned long long select_rng;       /* xorshift state of random select */
     CPU_Stage rob;
     
 } APEX_CPU;
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
+const char *get_opcode_str(int opcode);
 APEX_CPU *APEX_cpu_init(const char *filename);
+void print_code_memory(const APEX_CPU *cpu);
 APEX_CPU *initialize(const char *filename);
 void APEX_cpu_run(APEX_CPU *cpu);
 void APEX_cpu_stop(APEX_CPU *cpu);
@@ -175,6 +331,10 @@ void add_into_rob(APEX_CPU *cpu, CPU_Stage *inst, int arch_reg);
 void create_entry_in_rename_table(APEX_CPU *cpu, int phy_reg, int dest_reg);
 int get_entry_from_rename_table(APEX_CPU *cpu, int dest_reg);
 int get_free_reg_from_RF(APEX_CPU *cpu);
+int is_free_reg_from_RF_available(APEX_CPU *cpu);
+void initialize_free_list(FREE_LIST *free_list);
+int allocate_from_free_list(FREE_LIST *free_list);
+void release_to_free_list(FREE_LIST *free_list, int phy_reg);
 int is_iq_empty(IQ *iq);
 int is_iq_full(IQ *iq);
 IQ_SLOT create_entry_for_issue_queue(APEX_CPU *cpu, CPU_Stage *inst);
@@ -190,9 +350,9 @@ void initialize_bis(BIS *bis);
 int is_bis_empty(BIS *bis);
 
 int is_bis_full(BIS *bis);
-void remove_from_bis(BIS *bis);
+void remove_from_bis(BIS *bis, int branch_id);
 
-void add_into_bis(BIS *bis, int rob_index);
+int add_into_bis(BIS *bis, int rob_index);
 
 
 void create_entry_in_rename_table(APEX_CPU *cpu, int arch_reg, int phy_reg);
@@ -202,22 +362,26 @@ int is_iq_empty(IQ *iq);
 int is_iq_full(IQ *iq);
 void add_into_iq(APEX_CPU *cpu, CPU_Stage *inst);
 void add_into_rob(APEX_CPU *cpu, CPU_Stage *inst, int arch_reg);
-void flush_instruction_from_issue_queue(APEX_CPU *cpu, int rob_index);
-void flush_instruction_from_function_units(APEX_CPU *cpu, int rob_index);
-void flush_instruction_from_rob(APEX_CPU *cpu, int rob_index);
-int is_instruction_for_intfu(IQ_SLOT *iq_entry);
-int is_instruction_for_mulfu(IQ_SLOT *iq_entry);
-int is_instruction_for_m1(IQ_SLOT *iq_entry);
-int is_instruction_for_jbu1(IQ_SLOT *iq_entry);
+void flush_instruction_from_issue_queue(APEX_CPU *cpu, unsigned int branch_bit);
+void flush_instruction_from_function_units(APEX_CPU *cpu, unsigned int branch_bit);
+void flush_instruction_from_rob(APEX_CPU *cpu, unsigned int branch_bit);
+void release_branch(APEX_CPU *cpu, int branch_id);
 int is_branch_inst(int opcode);
-int are_all_stage_busy(APEX_CPU *cpu);
-void remove_empty_segments_from_iq(APEX_CPU *cpu);
-int is_instruction_valid_for_issuing(APEX_CPU *cpu, IQ_SLOT *inst);
-int is_instruction_at_the_head_of_rob(APEX_CPU *cpu, IQ_SLOT *inst);
+int get_fu_class(const char *label);
+int get_select_policy(const char *option);
+const char *get_select_policy_str(int policy);
+int build_function_units(APEX_CPU *cpu);
+int can_function_unit_accept(const FU_UNIT *unit);
+void remove_from_iq(IQ *iq, int slot);
+void issue_to_function_unit(FU_UNIT *unit, IQ_SLOT *inst);
+void broadcast_result(APEX_CPU *cpu, int phy_reg, int value);
+int is_lsq_full(LSQ *lsq);
+int add_into_lsq(APEX_CPU *cpu, CPU_Stage *inst);
+void flush_instruction_from_lsq(APEX_CPU *cpu, unsigned int branch_bit);
 
-void restore_rename_table(APEX_CPU *cpu, int checkpoint_info);
+void take_checkpoint(APEX_CPU *cpu, int checkpoint_info);
 
-void restore_regs_file(APEX_CPU *cpu, int checkpoint_info);
+void restore_rename_table(APEX_CPU *cpu, int checkpoint_info);
 
-void flush_the_instructions_followed_branch(APEX_CPU *cpu, int rob_index, int checkpoint_info);
+void flush_the_instructions_followed_branch(APEX_CPU *cpu, IQ_SLOT *branch);
 #endif
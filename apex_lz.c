@@ -0,0 +1,196 @@
+/*
+ * apex_lz.c
+ * Contains the LZ77 block codec used to compress trace output. It trades
+ * ratio for speed: one hash probe per position, no match search chains.
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <string.h>
+
+#include "apex_lz.h"
+
+#define HASH_BITS 12
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+
+static uint32_t
+read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Writes the extra bytes of a length that did not fit its nibble */
+static uint8_t *
+put_length(uint8_t *op, uint8_t *end, size_t len)
+{
+    while (len >= 255)
+    {
+        if (op >= end)
+        {
+            return NULL;
+        }
+        *op++ = 255;
+        len -= 255;
+    }
+    if (op >= end)
+    {
+        return NULL;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/* Emits one sequence, match_len 0 for the literal-only tail */
+static uint8_t *
+put_sequence(uint8_t *op, uint8_t *end, const uint8_t *literals, size_t lit_len,
+             size_t offset, size_t match_len)
+{
+    size_t match_code = match_len ? match_len - MIN_MATCH : 0;
+    uint8_t *token = op;
+
+    if (op >= end)
+    {
+        return NULL;
+    }
+    op++;
+    *token = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+    if (lit_len >= 15 && !(op = put_length(op, end, lit_len - 15)))
+    {
+        return NULL;
+    }
+    if ((size_t)(end - op) < lit_len)
+    {
+        return NULL;
+    }
+    memcpy(op, literals, lit_len);
+    op += lit_len;
+    if (match_len)
+    {
+        if (end - op < 2)
+        {
+            return NULL;
+        }
+        *op++ = (uint8_t)(offset & 0xff);
+        *op++ = (uint8_t)(offset >> 8);
+        if (match_code >= 15 && !(op = put_length(op, end, match_code - 15)))
+        {
+            return NULL;
+        }
+    }
+    return op;
+}
+
+size_t
+apex_lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap)
+{
+    int32_t table[1 << HASH_BITS];
+    uint8_t *op = dst;
+    uint8_t *end = dst + cap;
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    memset(table, 0xff, sizeof(table));
+    while (ip + MIN_MATCH <= n)
+    {
+        uint32_t seq = read32(src + ip);
+        uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+        int32_t ref = table[h];
+
+        table[h] = (int32_t)ip;
+        if (ref >= 0 && ip - ref <= MAX_OFFSET && read32(src + ref) == seq)
+        {
+            size_t len = MIN_MATCH;
+            while (ip + len < n && src[ref + len] == src[ip + len])
+            {
+                len++;
+            }
+            op = put_sequence(op, end, src + anchor, ip - anchor, ip - ref, len);
+            if (!op)
+            {
+                return 0;
+            }
+            ip += len;
+            anchor = ip;
+        }
+        else
+        {
+            ip++;
+        }
+    }
+    op = put_sequence(op, end, src + anchor, n - anchor, 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+/* Reads the extra bytes of a length whose nibble was 15 */
+static int
+get_length(const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+    uint8_t b;
+    do
+    {
+        if (*ip >= end)
+        {
+            return 0;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 1;
+}
+
+size_t
+apex_lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap)
+{
+    const uint8_t *ip = src;
+    const uint8_t *end = src + n;
+    size_t op = 0;
+
+    while (ip < end)
+    {
+        uint8_t token = *ip++;
+        size_t lit_len = token >> 4;
+        size_t match_len = token & 15;
+        size_t offset;
+
+        if (lit_len == 15 && !get_length(&ip, end, &lit_len))
+        {
+            return 0;
+        }
+        if ((size_t)(end - ip) < lit_len || cap - op < lit_len)
+        {
+            return 0;
+        }
+        memcpy(dst + op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        if (ip == end)
+        {
+            break; // the last sequence has no match
+        }
+        if (end - ip < 2)
+        {
+            return 0;
+        }
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (match_len == 15 && !get_length(&ip, end, &match_len))
+        {
+            return 0;
+        }
+        match_len += MIN_MATCH;
+        if (offset == 0 || offset > op || cap - op < match_len)
+        {
+            return 0;
+        }
+        // byte at a time, the match may overlap what it is copying
+        for (size_t i = 0; i < match_len; i++, op++)
+        {
+            dst[op] = dst[op - offset];
+        }
+    }
+    return op;
+}
@@ -0,0 +1,32 @@
+/*
+ * apex_lz.h
+ * Contains a small LZ77 block codec used to compress trace output
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_LZ_H_
+#define _APEX_LZ_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A compressed file starts with this word, followed by blocks of
+ * {uint32 raw_len, uint32 stored_len, stored_len bytes}. stored_len equal
+ * to raw_len means the block did not shrink and is stored as is. */
+#define APEX_LZ_MAGIC 0x5A585041 /* "APXZ" */
+
+/*
+ * Compresses n bytes of src into dst, returns the compressed size or 0 if
+ * it would not fit in cap bytes. The stream is a sequence of
+ * {token, literals, 16-bit offset} in the usual LZ4 layout: the high
+ * nibble of the token is the literal count, the low nibble the match
+ * length minus 4, 15 in either meaning more length bytes follow.
+ */
+size_t apex_lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+
+/* Returns the decompressed size, or 0 if src is corrupt or dst too small */
+size_t apex_lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+
+#endif
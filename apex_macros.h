@@ -12,46 +12,186 @@
 #define FALSE 0x0
 #define TRUE 0x1
 
-/* Integers */
+/* Words of data memory unless --mem-size says otherwise, only the pages
+ * written are allocated */
 #define DATA_MEMORY_SIZE 4096
 
+/* ROB exception codes, raised when the instruction executes and taken when
+ * it reaches the head */
+#define EXCEPTION_MEMORY_FAULT 1 /* load or store outside data memory */
+
 /* Size of integer register file */
+#ifndef REG_FILE_SIZE
 #define REG_FILE_SIZE 48
+#endif
+
+/* 64-bit words in the physical register free list bitmap */
+#define FREE_LIST_WORDS ((REG_FILE_SIZE + 63) / 64)
 
 /* Size of integer register file */
 #define R_TABLE_SIZE 16
 
-/* Size of BIS */
+/* The zero flag is renamed like one more architectural register */
+#define ZERO_FLAG_REG R_TABLE_SIZE
+#define RENAME_TABLE_SIZE (R_TABLE_SIZE + 1)
+
+/* Size of BIS, at most 32 since branch masks are one unsigned int */
+#ifndef BIS_SIZE
 #define BIS_SIZE 16
+#endif
+#if BIS_SIZE > 32
+#error "BIS_SIZE must fit in an unsigned int branch mask"
+#endif
 
 /* Size of ROB */
 #define ROB_SIZE 64
 
+/* Instructions fetched, dispatched and committed per cycle. The defaults
+ * are the scalar pipeline, the options can raise each up to MAX_WIDTH */
+#define MAX_WIDTH 8
+#define FETCH_WIDTH 1
+#define DISPATCH_WIDTH 1
+#define COMMIT_WIDTH 1
+
 /*Size of IQ*/
+#ifndef IQ_SIZE
 #define IQ_SIZE 24
+#endif
+
+/* Loads and stores in flight between dispatch and commit */
+#ifndef LSQ_SIZE
+#define LSQ_SIZE 32
+#endif
+
+/* 64-bit words in the IQ occupancy and ready bitmaps */
+#define IQ_WORDS ((IQ_SIZE + 63) / 64)
+
+/*
+ * Functional unit classes an instruction is steered to at issue, with the
+ * default pool: X(name, label, units, latency, pipelined). A pipelined unit
+ * starts an instruction every cycle, an unpipelined one holds it for the
+ * whole latency. MEM and JBU units are the two-stage m1/m2 and jbu1/jbu2
+ * pipes, only how many there are can be changed.
+ */
+#define APEX_FU_TABLE(X)        \
+    X(INT, "int", 1, 1, 1)      \
+    X(MUL, "mul", 1, 3, 0)      \
+    X(MEM, "mem", 1, 2, 1)      \
+    X(JBU, "jbu", 1, 2, 1)      \
+    X(DIV, "div", 1, 8, 0)
+
+enum
+{
+    FU_NONE,
+#define X(name, label, units, latency, pipelined) FU_##name,
+    APEX_FU_TABLE(X)
+#undef X
+    NUM_FU_CLASSES
+};
+
+/* Classes that compute a result in one stage repeated for their latency */
+#define FU_IS_COMPUTE(fu_class) ((fu_class) == FU_INT || (fu_class) == FU_MUL || (fu_class) == FU_DIV)
+
+/* Units in the pool, all classes together, and the longest latency */
+#define MAX_FUS 16
+#define MAX_FU_LATENCY 32
+
+/* How an issue port picks among the ready instructions of its class,
+ * X(name, option): the lowest IQ slot, the oldest by the age matrix, or
+ * one at random */
+#define APEX_SELECT_TABLE(X)        \
+    X(POSITION, "position")         \
+    X(OLDEST, "oldest")             \
+    X(RANDOM, "random")
+
+enum
+{
+#define X(name, option) SELECT_##name,
+    APEX_SELECT_TABLE(X)
+#undef X
+    NUM_SELECT_POLICIES
+};
+#define SELECT_DEFAULT SELECT_POSITION
+#define SELECT_SEED 0x9e3779b97f4a7c15ULL /* random select is repeatable run to run */
+
+/* Flags of a predecoded instruction */
+#define INSN_HAS_DEST 0x1
+#define INSN_SETS_ZERO 0x2
+#define INSN_IS_BRANCH 0x4
+#define INSN_IS_LOAD 0x8
+#define INSN_IS_STORE 0x10
+#define INSN_READS_ZERO 0x20
+
+/* Operand fields, in the order they are written in the assembly text */
+#define OPND_NONE 0
+#define OPND_RD 1
+#define OPND_RS1 2
+#define OPND_RS2 3
+#define OPND_RS3 4
+#define OPND_IMM 5
+#define MAX_OPERANDS 3
+
+/*
+ * Operand formats: X(name, first, second, third operand)
+ */
+#define APEX_FORMAT_TABLE(X)                                \
+    X(NONE, OPND_NONE, OPND_NONE, OPND_NONE)                \
+    X(RRR,  OPND_RD,   OPND_RS1,  OPND_RS2)                 \
+    X(RI,   OPND_RD,   OPND_IMM,  OPND_NONE)                \
+    X(RRI,  OPND_RD,   OPND_RS1,  OPND_IMM)                 \
+    X(SS,   OPND_RS1,  OPND_RS2,  OPND_NONE)                \
+    X(SSI,  OPND_RS1,  OPND_RS2,  OPND_IMM)                 \
+    X(SSS,  OPND_RS1,  OPND_RS2,  OPND_RS3)                 \
+    X(I,    OPND_IMM,  OPND_NONE, OPND_NONE)                \
+    X(SI,   OPND_RS1,  OPND_IMM,  OPND_NONE)
+
+enum
+{
+#define X(name, o1, o2, o3) FMT_##name,
+    APEX_FORMAT_TABLE(X)
+#undef X
+    NUM_FORMATS
+};
+
+/*
+ * Opcode descriptor table, one line per instruction:
+ *   X(name, mnemonic, format, sources, FU class, latency, flags)
+ * sources is the number of rs1/rs2/rs3 fields read, in that order. INT,
+ * MUL and DIV instructions run for their class's latency in the FU pool,
+ * the latency here matches its default. The numeric OPCODE_* identifiers
+ * follow the order of this list, so new instructions go at the end.
+ */
+#define APEX_OPCODE_TABLE(X)                                                      \
+    X(ADD,   "ADD",   FMT_RRR,  2, FU_INT,  1, INSN_HAS_DEST | INSN_SETS_ZERO)    \
+    X(SUB,   "SUB",   FMT_RRR,  2, FU_INT,  1, INSN_HAS_DEST | INSN_SETS_ZERO)    \
+    X(MUL,   "MUL",   FMT_RRR,  2, FU_MUL,  3, INSN_HAS_DEST)                     \
+    X(DIV,   "DIV",   FMT_RRR,  2, FU_DIV,  8, INSN_HAS_DEST)                     \
+    X(AND,   "AND",   FMT_RRR,  2, FU_INT,  1, INSN_HAS_DEST)                     \
+    X(OR,    "OR",    FMT_RRR,  2, FU_INT,  1, INSN_HAS_DEST)                     \
+    X(XOR,   "EXOR",  FMT_RRR,  2, FU_INT,  1, INSN_HAS_DEST)                     \
+    X(MOVC,  "MOVC",  FMT_RI,   0, FU_INT,  1, INSN_HAS_DEST)                     \
+    X(LOAD,  "LOAD",  FMT_RRI,  1, FU_MEM,  2, INSN_HAS_DEST | INSN_IS_LOAD)      \
+    X(STORE, "STORE", FMT_SSI,  2, FU_MEM,  2, INSN_IS_STORE)                     \
+    X(BZ,    "BZ",    FMT_I,    0, FU_JBU,  1, INSN_IS_BRANCH | INSN_READS_ZERO)  \
+    X(BNZ,   "BNZ",   FMT_I,    0, FU_JBU,  1, INSN_IS_BRANCH | INSN_READS_ZERO)  \
+    X(HALT,  "HALT",  FMT_NONE, 0, FU_NONE, 1, 0)                                 \
+    X(STR,   "STR",   FMT_SSS,  3, FU_MEM,  2, INSN_IS_STORE)                     \
+    X(LDR,   "LDR",   FMT_RRR,  2, FU_MEM,  2, INSN_HAS_DEST | INSN_IS_LOAD)      \
+    X(ADDL,  "ADDL",  FMT_RRI,  1, FU_INT,  1, INSN_HAS_DEST)                     \
+    X(SUBL,  "SUBL",  FMT_RRI,  1, FU_INT,  1, INSN_HAS_DEST)                     \
+    X(CMP,   "CMP",   FMT_SS,   2, FU_INT,  1, INSN_SETS_ZERO)                    \
+    X(NOP,   "NOP",   FMT_NONE, 0, FU_NONE, 1, 0)                                 \
+    X(JAL,   "JAL",   FMT_RRI,  1, FU_JBU,  2, INSN_HAS_DEST | INSN_IS_BRANCH)    \
+    X(JUMP,  "JUMP",  FMT_SI,   1, FU_JBU,  2, INSN_IS_BRANCH)
 
 /* Numeric OPCODE identifiers for instructions */
-#define OPCODE_ADD 0x0
-#define OPCODE_SUB 0x1
-#define OPCODE_MUL 0x2
-#define OPCODE_DIV 0x3
-#define OPCODE_AND 0x4
-#define OPCODE_OR 0x5
-#define OPCODE_XOR 0x6
-#define OPCODE_MOVC 0x7
-#define OPCODE_LOAD 0x8
-#define OPCODE_STORE 0x9
-#define OPCODE_BZ 0xa
-#define OPCODE_BNZ 0xb
-#define OPCODE_HALT 0xc
-#define OPCODE_STR 0xd
-#define OPCODE_LDR 0xe
-#define OPCODE_ADDL 0xf
-#define OPCODE_SUBL 0x10
-#define OPCODE_CMP 0x11
-#define OPCODE_NOP 0x12
-#define OPCODE_JAL 0x13
-#define OPCODE_JUMP 0x14
+enum
+{
+#define X(name, mnemonic, format, srcs, fu_class, latency, flags) OPCODE_##name,
+    APEX_OPCODE_TABLE(X)
+#undef X
+    NUM_OPCODES
+};
 
 /* Variables used for registers status */
 #define VALID 1
@@ -61,12 +201,33 @@
 #define ENABLE_DEBUG_MESSAGES 1
 #define DISABLE_DEBUG_MESSAGES 0
 
-/* Flags for IQ Status bit */
-#define ALLOCATED 1
-#define UNALLOCATED 0
+/* Trace levels. Anything above APEX_TRACE_LEVEL is compiled out, the rest
+ * can be turned down at run time through cpu->trace_level */
+#define TRACE_NONE 0  /* final report only */
+#define TRACE_STAGE 1 /* code memory, cycle banner and stage contents */
+#define TRACE_EVENT 2 /* issue, writeback, squash and commit of each instruction */
+#ifndef APEX_TRACE_LEVEL
+#define APEX_TRACE_LEVEL (ENABLE_DEBUG_MESSAGES ? TRACE_STAGE : TRACE_NONE)
+#endif
+
+#define TRACE_ON(cpu, level) ((level) <= APEX_TRACE_LEVEL && (cpu)->trace_level >= (level))
+#define TRACE(cpu, level, ...)          \
+    do                                  \
+    {                                   \
+        if (TRACE_ON(cpu, level))       \
+        {                               \
+            apex_printf(__VA_ARGS__);   \
+        }                               \
+    } while (0)
 
 /* Set this flag to 1 to enable cycle single-step mode */
 #define ENABLE_SINGLE_STEP 1
 #define DISABLE_SINGLE_STEP 0
 
+/* Set this flag to 1 to let simulate mode jump over cycles in which only
+ * functional unit timers advance */
+#ifndef ENABLE_CYCLE_SKIP
+#define ENABLE_CYCLE_SKIP 1
+#endif
+
 #endif
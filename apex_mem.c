@@ -0,0 +1,466 @@
+/*
+ * apex_mem.c
+ * Contains the data memory, a sparse word-addressed store whose pages are
+ * allocated when first written, and its image loading and dumping
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#define _GNU_SOURCE /* copy_file_range */
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_macros.h"
+#include "apex_mem.h"
+
+#define ROOT_INDEX(page) ((page) >> MEM_LEAF_BITS)
+#define LEAF_INDEX(page) ((page) & ((1 << MEM_LEAF_BITS) - 1))
+
+/* Creates an empty memory of size words, NULL if size is not positive */
+APEX_Memory *
+apex_mem_create(int size)
+{
+    APEX_Memory *mem;
+
+    if (size < 1)
+    {
+        return NULL;
+    }
+    mem = calloc(1, sizeof(APEX_Memory));
+    if (!mem)
+    {
+        return NULL;
+    }
+    mem->size = size;
+    mem->last_page = -1;
+    mem->image_fd = -1;
+    return mem;
+}
+
+/* TRUE if page lies in the mapped image rather than being allocated */
+static int
+in_image(const APEX_Memory *mem, const int *page)
+{
+    return mem->image && (const char *)page >= mem->image &&
+           (const char *)page < mem->image + mem->image_bytes;
+}
+
+void
+apex_mem_free(APEX_Memory *mem)
+{
+    if (!mem)
+    {
+        return;
+    }
+    for (int r = 0; r < (1 << MEM_ROOT_BITS); r++)
+    {
+        for (int l = 0; mem->root[r] && l < (1 << MEM_LEAF_BITS); l++)
+        {
+            if (!in_image(mem, mem->root[r]->page[l]))
+            {
+                free(mem->root[r]->page[l]);
+            }
+        }
+        free(mem->root[r]);
+    }
+    if (mem->image)
+    {
+        munmap(mem->image, mem->image_bytes);
+        close(mem->image_fd);
+    }
+    free(mem);
+}
+
+int
+apex_mem_valid(const APEX_Memory *mem, int address)
+{
+    return address >= 0 && address < mem->size;
+}
+
+/* The leaf table holding page, NULL if it does not exist and allocate is
+ * FALSE or it cannot be allocated */
+static MEM_LEAF *
+find_leaf(APEX_Memory *mem, int page, int allocate)
+{
+    MEM_LEAF **leaf = &mem->root[ROOT_INDEX(page)];
+
+    if (!*leaf && allocate)
+    {
+        *leaf = calloc(1, sizeof(MEM_LEAF));
+    }
+    return *leaf;
+}
+
+/* The words of page, NULL if it was never written and allocate is FALSE
+ * or it cannot be allocated */
+static int *
+find_page(APEX_Memory *mem, int page, int allocate)
+{
+    MEM_LEAF *leaf;
+    int **slot;
+
+    if (page == mem->last_page)
+    {
+        return mem->last;
+    }
+    leaf = find_leaf(mem, page, allocate);
+    if (!leaf)
+    {
+        return NULL;
+    }
+    slot = &leaf->page[LEAF_INDEX(page)];
+    if (!*slot)
+    {
+        if (!allocate || !(*slot = calloc(MEM_PAGE_WORDS, sizeof(int))))
+        {
+            return NULL;
+        }
+        mem->pages++;
+    }
+    mem->last_page = page;
+    mem->last = *slot;
+    mem->last_dirty = &leaf->dirty[LEAF_INDEX(page)];
+    return *slot;
+}
+
+/* The word at address, 0 outside memory so a load on a wrong path can
+ * read anything */
+int
+apex_mem_read(APEX_Memory *mem, int address)
+{
+    int *page;
+
+    if (!apex_mem_valid(mem, address))
+    {
+        return 0;
+    }
+    page = find_page(mem, address >> MEM_PAGE_BITS, FALSE);
+    return page ? page[address & (MEM_PAGE_WORDS - 1)] : 0;
+}
+
+/* FALSE if address is outside memory or its page cannot be allocated */
+int
+apex_mem_write(APEX_Memory *mem, int address, int value)
+{
+    int *page;
+
+    if (!apex_mem_valid(mem, address))
+    {
+        return FALSE;
+    }
+    page = find_page(mem, address >> MEM_PAGE_BITS, TRUE);
+    if (!page)
+    {
+        return FALSE;
+    }
+    page[address & (MEM_PAGE_WORDS - 1)] = value;
+    *mem->last_dirty = TRUE;
+    return TRUE;
+}
+
+/* Puts a word of an image in memory; its page is not counted as a store's,
+ * and is dirty only if the image has no binary file to copy it from */
+static int
+image_word(APEX_Memory *mem, long address, int value, int dirty)
+{
+    MEM_LEAF *leaf;
+    int **slot;
+
+    if (address < 0 || address >= mem->size)
+    {
+        return FALSE;
+    }
+    leaf = find_leaf(mem, address >> MEM_PAGE_BITS, TRUE);
+    if (!leaf)
+    {
+        return FALSE;
+    }
+    slot = &leaf->page[LEAF_INDEX(address >> MEM_PAGE_BITS)];
+    if (!*slot && !(*slot = calloc(MEM_PAGE_WORDS, sizeof(int))))
+    {
+        return FALSE;
+    }
+    (*slot)[address & (MEM_PAGE_WORDS - 1)] = value;
+    leaf->dirty[LEAF_INDEX(address >> MEM_PAGE_BITS)] |= dirty;
+    return TRUE;
+}
+
+/* Words in host order. From a page boundary on, whole pages of the image
+ * become pages of memory as they are, only a partial one is copied */
+static int
+load_binary(APEX_Memory *mem, const char *data, size_t bytes, int base)
+{
+    long words = bytes / sizeof(int);
+    long w = 0;
+
+    if (bytes % sizeof(int) || base < 0 || base + words > mem->size)
+    {
+        return -1;
+    }
+    if (base % MEM_PAGE_WORDS == 0)
+    {
+        for (; w + MEM_PAGE_WORDS <= words; w += MEM_PAGE_WORDS)
+        {
+            MEM_LEAF *leaf = find_leaf(mem, (base + w) >> MEM_PAGE_BITS, TRUE);
+
+            if (!leaf)
+            {
+                return -1;
+            }
+            leaf->page[LEAF_INDEX((base + w) >> MEM_PAGE_BITS)] = (int *)data + w;
+        }
+    }
+    for (; w < words; w++)
+    {
+        int value;
+
+        memcpy(&value, data + w * sizeof(int), sizeof(int));
+        if (!image_word(mem, base + w, value, FALSE))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* $readmemh style text: hex words separated by white space, "@addr" moves
+ * to base + addr and "//" starts a comment */
+static int
+load_hex(APEX_Memory *mem, const char *text, size_t bytes, int base)
+{
+    const char *p = text;
+    const char *end = text + bytes;
+    long address = base;
+
+    while (p < end)
+    {
+        unsigned long value = 0;
+        int digits = 0;
+        int at;
+
+        if (isspace((unsigned char)*p))
+        {
+            p++;
+            continue;
+        }
+        if (*p == '/' && p + 1 < end && p[1] == '/')
+        {
+            while (p < end && *p != '\n')
+            {
+                p++;
+            }
+            continue;
+        }
+        at = *p == '@';
+        p += at;
+        for (; p < end && isxdigit((unsigned char)*p); p++, digits++)
+        {
+            value = value * 16 + (isdigit((unsigned char)*p) ? *p - '0' : tolower((unsigned char)*p) - 'a' + 10);
+        }
+        if (!digits || digits > 8 || (p < end && !isspace((unsigned char)*p)))
+        {
+            return -1;
+        }
+        if (at)
+        {
+            address = base + (long)value;
+        }
+        else if (!image_word(mem, address++, (int)(unsigned int)value, TRUE))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Fills memory from the image at path starting at word base, hex text if
+ * the name ends in ".hex" and binary words otherwise. The file is mapped,
+ * not read; a binary image stays mapped for as long as memory uses it.
+ * Returns 0, or -1 if the file cannot be mapped, is malformed or does not
+ * fit in memory.
+ */
+int
+apex_mem_load(APEX_Memory *mem, const char *path, int base)
+{
+    size_t len = strlen(path);
+    int hex = len > 4 && strcmp(path + len - 4, ".hex") == 0;
+    struct stat st;
+    char *data;
+    int fd = open(path, O_RDONLY);
+    int status;
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (mem->image || fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+    if (hex)
+    {
+        status = load_hex(mem, data, st.st_size, base);
+        munmap(data, st.st_size);
+        close(fd);
+    }
+    else
+    {
+        mem->image = data;
+        mem->image_bytes = st.st_size;
+        mem->image_fd = fd;
+        mem->image_base = base;
+        status = load_binary(mem, data, st.st_size, base);
+    }
+    mem->last_page = -1;
+    return status;
+}
+
+/* A write that makes no progress is an error too, it would never finish */
+static int
+write_all(int fd, const void *data, size_t bytes, off_t offset)
+{
+    const char *p = data;
+
+    while (bytes)
+    {
+        ssize_t n = pwrite(fd, p, bytes, offset);
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        bytes -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Copies bytes of the image file at from to fd at to inside the kernel,
+ * which shares the blocks where the filesystem can; what it will not copy
+ * is written from the mapping */
+static int
+copy_image(const APEX_Memory *mem, int fd, off_t from, off_t to, size_t bytes)
+{
+    while (bytes)
+    {
+        loff_t in = from;
+        loff_t out = to;
+        ssize_t n = copy_file_range(mem->image_fd, &in, fd, &out, bytes, 0);
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return write_all(fd, mem->image + from, bytes, to);
+        }
+        from += n;
+        to += n;
+        bytes -= n;
+    }
+    return 0;
+}
+
+/*
+ * Writes memory to path as a binary image loadable with apex_mem_load.
+ * Only dirty pages are written from memory; the clean pages of a binary
+ * image are copied from its file, and the ranges between pages are left
+ * as holes that read as 0. The file ends with the last page. It is
+ * written beside path and renamed over it, so path may be the image
+ * memory was loaded from. Returns 0, or -1 on an I/O error.
+ */
+int
+apex_mem_dump(const APEX_Memory *mem, const char *path)
+{
+    char tmp[strlen(path) + 8];
+    long image_end = mem->image_base + (long)(mem->image_bytes / sizeof(int));
+    long end = 0;
+    int status = 0;
+    int fd;
+
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+    fd = mkstemp(tmp);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    for (int r = 0; r < (1 << MEM_ROOT_BITS) && status == 0; r++)
+    {
+        for (int l = 0; mem->root[r] && l < (1 << MEM_LEAF_BITS) && status == 0; l++)
+        {
+            const MEM_LEAF *leaf = mem->root[r];
+            long first = (long)((r << MEM_LEAF_BITS) | l) << MEM_PAGE_BITS;
+            long words = mem->size - first < MEM_PAGE_WORDS ? mem->size - first : MEM_PAGE_WORDS;
+
+            if (!leaf->page[l])
+            {
+                continue;
+            }
+            end = first + words;
+            if (leaf->dirty[l])
+            {
+                status = write_all(fd, leaf->page[l], words * sizeof(int), first * sizeof(int));
+            }
+            else
+            {
+                // a clean page only has data where it overlaps the image
+                long from = first > mem->image_base ? first : mem->image_base;
+                long to = end < image_end ? end : image_end;
+
+                if (from < to)
+                {
+                    status = copy_image(mem, fd, (from - mem->image_base) * sizeof(int),
+                                        from * sizeof(int), (to - from) * sizeof(int));
+                }
+            }
+        }
+    }
+    if (status == 0 && ftruncate(fd, end * sizeof(int)) != 0)
+    {
+        status = -1;
+    }
+    if (fchmod(fd, 0644) != 0)
+    {
+        status = -1;
+    }
+    if (close(fd) != 0)
+    {
+        status = -1;
+    }
+    if (status == 0 && rename(tmp, path) != 0)
+    {
+        status = -1;
+    }
+    if (status != 0)
+    {
+        unlink(tmp);
+    }
+    return status;
+}
@@ -0,0 +1,58 @@
+/*
+ * apex_mem.h
+ * Contains the data memory, a sparse word-addressed store whose pages are
+ * allocated when first written
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_MEM_H_
+#define _APEX_MEM_H_
+
+/* An address splits into root index, leaf index and word in the page; the
+ * three cover every non-negative int */
+#define MEM_PAGE_BITS 10
+#define MEM_LEAF_BITS 10
+#define MEM_ROOT_BITS (31 - MEM_LEAF_BITS - MEM_PAGE_BITS)
+#define MEM_PAGE_WORDS (1 << MEM_PAGE_BITS)
+
+/*
+ * A two-level radix table: the root points at leaf tables of page
+ * pointers, both allocated on demand, so a program spread over a large
+ * range costs only the pages it writes. Pages never written read as 0.
+ * The last page used is kept aside, consecutive accesses to it skip the
+ * table walk. Pages of a binary image loaded at a page boundary point
+ * straight into its private mapping, the kernel copies one only when a
+ * store writes it. A page is dirty once a store writes it, a dump writes
+ * only those and copies the rest from the image file.
+ */
+typedef struct MEM_LEAF
+{
+    int *page[1 << MEM_LEAF_BITS];
+    unsigned char dirty[1 << MEM_LEAF_BITS]; /* differs from the image file */
+} MEM_LEAF;
+
+typedef struct APEX_Memory
+{
+    int size;      /* words, addresses are 0 to size - 1 */
+    MEM_LEAF *root[1 << MEM_ROOT_BITS];
+    int last_page; /* page number of last, -1 when none */
+    int *last;
+    unsigned char *last_dirty;
+    long pages;    /* pages allocated by stores */
+    char *image;   /* mapping of a binary image, NULL when none */
+    size_t image_bytes;
+    int image_fd;  /* its file, kept open for dumps, -1 when none */
+    int image_base;
+} APEX_Memory;
+
+APEX_Memory *apex_mem_create(int size);
+void apex_mem_free(APEX_Memory *mem);
+int apex_mem_valid(const APEX_Memory *mem, int address);
+int apex_mem_read(APEX_Memory *mem, int address);
+int apex_mem_write(APEX_Memory *mem, int address, int value);
+int apex_mem_load(APEX_Memory *mem, const char *path, int base);
+int apex_mem_dump(const APEX_Memory *mem, const char *path);
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * apex_prefetch.c
+ * Contains the stride prefetcher that watches the load addresses m1
+ * computes and fetches lines ahead of them into the L1D
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_prefetch.h"
+
+/* Instructions are 4 bytes apart, drop the bits that never change */
+#define PC_KEY(pc) ((unsigned int)(pc) >> 2)
+
+/*
+ * Creates a prefetcher with 2^table_bits entries that sends degree
+ * prefetches, starting distance strides ahead. Returns NULL for a size out
+ * of range or when the table cannot be allocated.
+ */
+APEX_Prefetcher *
+apex_prefetch_create(int degree, int distance, int table_bits)
+{
+    APEX_Prefetcher *pf;
+
+    if (degree < 1 || degree > MAX_PF_DEGREE || distance < 1 || table_bits < 0 ||
+        table_bits > 16)
+    {
+        return NULL;
+    }
+    pf = calloc(1, sizeof(APEX_Prefetcher));
+    if (!pf)
+    {
+        return NULL;
+    }
+    pf->table_bits = table_bits;
+    pf->degree = degree;
+    pf->distance = distance;
+    pf->table = malloc((1U << table_bits) * sizeof(PF_ENTRY));
+    if (!pf->table)
+    {
+        apex_prefetch_free(pf);
+        return NULL;
+    }
+    for (unsigned int i = 0; i < (1U << table_bits); ++i)
+    {
+        pf->table[i].pc = -1;
+    }
+    snprintf(pf->name, sizeof(pf->name), "stride, degree %d, distance %d, %u entries", degree,
+             distance, 1U << table_bits);
+    return pf;
+}
+
+void
+apex_prefetch_free(APEX_Prefetcher *pf)
+{
+    if (!pf)
+    {
+        return;
+    }
+    free(pf->table);
+    free(pf);
+}
+
+/*
+ * Trains the entry of the load at pc with the address it computed. Once
+ * the load has repeated a stride, writes the addresses to prefetch to
+ * targets, up to MAX_PF_DEGREE of them, and returns how many.
+ */
+int
+apex_prefetch_observe(APEX_Prefetcher *pf, int pc, int address, int *targets)
+{
+    PF_ENTRY *entry = &pf->table[PC_KEY(pc) & ((1U << pf->table_bits) - 1)];
+    int stride;
+
+    if (entry->pc != pc)
+    {
+        entry->pc = pc;
+        entry->last = address;
+        entry->stride = 0;
+        entry->confidence = 0;
+        return 0;
+    }
+    stride = address - entry->last;
+    entry->last = address;
+    if (stride == entry->stride && stride != 0)
+    {
+        entry->confidence += entry->confidence < 3;
+    }
+    else if (entry->confidence > 0)
+    {
+        entry->confidence--;
+    }
+    else
+    {
+        entry->stride = stride;
+    }
+    if (entry->confidence < PF_CONFIDENT)
+    {
+        return 0;
+    }
+    for (int i = 0; i < pf->degree; i++)
+    {
+        targets[i] = address + entry->stride * (pf->distance + i);
+    }
+    return pf->degree;
+}
@@ -0,0 +1,41 @@
+/*
+ * apex_prefetch.h
+ * Contains the stride prefetcher that watches the load addresses m1
+ * computes and fetches lines ahead of them into the L1D
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_PREFETCH_H_
+#define _APEX_PREFETCH_H_
+
+/* Defaults; all can be changed with options. Distance is how many strides
+ * ahead of the load the first prefetch goes, degree how many follow it */
+#define PF_TABLE_BITS 6
+#define PF_DISTANCE 4
+#define MAX_PF_DEGREE 16
+#define PF_CONFIDENT 2 /* repeats of a stride before it is trusted */
+
+typedef struct PF_ENTRY
+{
+    int pc;         /* load the entry belongs to, -1 when empty */
+    int last;       /* its previous address */
+    int stride;
+    int confidence; /* 0 to 3 */
+} PF_ENTRY;
+
+typedef struct APEX_Prefetcher
+{
+    PF_ENTRY *table; /* direct-mapped on the load's pc */
+    int table_bits;
+    int degree;
+    int distance;
+    char name[64];   /* configuration, for the report */
+} APEX_Prefetcher;
+
+APEX_Prefetcher *apex_prefetch_create(int degree, int distance, int table_bits);
+void apex_prefetch_free(APEX_Prefetcher *pf);
+int apex_prefetch_observe(APEX_Prefetcher *pf, int pc, int address, int *targets);
+
+#endif
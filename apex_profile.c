@@ -0,0 +1,106 @@
+/*
+ * apex_profile.c
+ * Contains the per-instruction profile and the annotated listing written
+ * with --profile
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_profile.h"
+
+int
+apex_profile_init(APEX_Profile *profile, int code_size)
+{
+    profile->entries = calloc(code_size, sizeof(APEX_Profile_Entry));
+    profile->size = code_size;
+    profile->last_commit = 0;
+    return profile->entries != NULL;
+}
+
+void
+apex_profile_free(APEX_Profile *profile)
+{
+    free(profile->entries);
+    profile->entries = NULL;
+}
+
+/* One row of numbers, blank columns for what does not apply to the line */
+static void
+write_row(FILE *file, const APEX_Profile_Entry *entry, int is_branch, unsigned long long cycles)
+{
+    fprintf(file, "%9llu %9llu %6.1f%% %9llu %9llu", entry->commits, entry->head_cycles,
+            cycles ? 100.0 * entry->head_cycles / cycles : 0.0, entry->iq_cycles,
+            entry->dispatch_stalls);
+    if (is_branch && entry->commits)
+    {
+        fprintf(file, " %6.1f%% %9llu", 100.0 * entry->taken / entry->commits, entry->redirects);
+    }
+    else
+    {
+        fprintf(file, " %7s %9s", "", "");
+    }
+}
+
+/*
+ * Writes the program source with each line's counters in front of it, in
+ * the spirit of perf annotate. Line i of the source is code memory index
+ * i, which is how create_code_memory reads it.
+ */
+int
+apex_profile_write(const APEX_CPU *cpu, const char *source, const char *path)
+{
+    const APEX_Profile *profile = &cpu->profile;
+    FILE *in = fopen(source, "r");
+    FILE *out;
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t nread;
+    int index = 0;
+
+    if (!in)
+    {
+        return -1;
+    }
+    out = fopen(path, "w");
+    if (!out)
+    {
+        fclose(in);
+        return -1;
+    }
+    fprintf(out, "; APEX profile of %s: %llu cycles, %llu instructions excluding HALT\n", source,
+            cpu->stats.cycles, cpu->stats.instructions);
+    fprintf(out, "; commits: times the line committed, head: cycles it blocked commit at the\n"
+                 "; ROB head (and share of the run), iq: cycles from IQ insert to issue,\n"
+                 "; stall: cycles decode held it back, taken/redirect: branches only\n");
+    fprintf(out, ";%8s %9s %7s %9s %9s %7s %9s | %s\n", "commits", "head", "head%", "iq", "stall",
+            "taken", "redirect", "source");
+    while ((nread = getline(&line, &len, in)) != -1)
+    {
+        while (nread > 0 && (line[nread - 1] == '\n' || line[nread - 1] == '\r'))
+        {
+            line[--nread] = '\0';
+        }
+        if (index < profile->size)
+        {
+            int is_branch = (cpu->code_memory[index].flags & INSN_IS_BRANCH) != 0;
+
+            write_row(out, &profile->entries[index], is_branch, cpu->stats.cycles);
+        }
+        else
+        {
+            fprintf(out, "%65s", "");
+        }
+        fprintf(out, " | %s\n", line);
+        index++;
+    }
+    free(line);
+    fclose(in);
+    return fclose(out);
+}
@@ -0,0 +1,38 @@
+/*
+ * apex_profile.h
+ * Contains the per-instruction profile: counters kept for every line of
+ * the program and written out as an annotated copy of the source
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_PROFILE_H_
+#define _APEX_PROFILE_H_
+
+/* Counters of one static instruction, all but dispatch_stalls are added
+ * when an instance commits */
+typedef struct APEX_Profile_Entry
+{
+    unsigned long long commits;
+    unsigned long long head_cycles;     /* at the ROB head without committing */
+    unsigned long long iq_cycles;       /* from IQ insert to issue */
+    unsigned long long dispatch_stalls; /* cycles decode held it back */
+    unsigned long long taken;           /* control transfers that went to their target */
+    unsigned long long redirects;       /* times it squashed younger work and refetched */
+} APEX_Profile_Entry;
+
+typedef struct APEX_Profile
+{
+    APEX_Profile_Entry *entries; /* one per code memory index */
+    int size;
+    int last_commit; /* cycle of the last commit, the next head's start */
+} APEX_Profile;
+
+struct APEX_CPU;
+
+int apex_profile_init(APEX_Profile *profile, int code_size);
+void apex_profile_free(APEX_Profile *profile);
+int apex_profile_write(const struct APEX_CPU *cpu, const char *source, const char *path);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * apex_simd.c
+ * Contains scalar, SSE2 and AVX2 versions of the issue queue tag-match
+ * and branch-mask kernels. The widest one the host supports is picked at start-up unless
+ * the build defines APEX_NO_SIMD.
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include "apex_simd.h"
+
+#if !defined(APEX_NO_SIMD) && (defined(__x86_64__) || defined(__i386__))
+#define APEX_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+static void
+tag_match_scalar(const int *fields, int count, int key, unsigned long long *mask)
+{
+    for (int i = 0; i < count; i += 64)
+    {
+        unsigned long long bits = 0;
+        for (int j = 0; j < 64; j++)
+        {
+            bits |= (unsigned long long)(fields[i + j] == key) << j;
+        }
+        mask[i / 64] = bits;
+    }
+}
+
+static void
+mask_match_scalar(const int *fields, int count, int key, unsigned long long *mask)
+{
+    for (int i = 0; i < count; i += 64)
+    {
+        unsigned long long bits = 0;
+        for (int j = 0; j < 64; j++)
+        {
+            bits |= (unsigned long long)((fields[i + j] & key) != 0) << j;
+        }
+        mask[i / 64] = bits;
+    }
+}
+
+static void
+mask_clear_scalar(int *fields, int count, int bits)
+{
+    for (int i = 0; i < count; i++)
+    {
+        fields[i] &= ~bits;
+    }
+}
+
+#ifdef APEX_HAVE_X86_SIMD
+__attribute__((target("sse2"))) static void
+tag_match_sse2(const int *fields, int count, int key, unsigned long long *mask)
+{
+    __m128i k = _mm_set1_epi32(key);
+
+    for (int i = 0; i < count; i += 64)
+    {
+        unsigned long long bits = 0;
+        for (int j = 0; j < 64; j += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)&fields[i + j]);
+            int m = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, k)));
+            bits |= (unsigned long long)m << j;
+        }
+        mask[i / 64] = bits;
+    }
+}
+
+__attribute__((target("sse2"))) static void
+mask_match_sse2(const int *fields, int count, int key, unsigned long long *mask)
+{
+    __m128i k = _mm_set1_epi32(key);
+    __m128i zero = _mm_setzero_si128();
+
+    for (int i = 0; i < count; i += 64)
+    {
+        unsigned long long bits = 0;
+        for (int j = 0; j < 64; j += 4)
+        {
+            __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)&fields[i + j]), k);
+            int m = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, zero)));
+            bits |= (unsigned long long)(~m & 0xf) << j;
+        }
+        mask[i / 64] = bits;
+    }
+}
+
+__attribute__((target("sse2"))) static void
+mask_clear_sse2(int *fields, int count, int bits)
+{
+    __m128i k = _mm_set1_epi32(bits);
+
+    for (int i = 0; i < count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&fields[i]);
+        _mm_storeu_si128((__m128i *)&fields[i], _mm_andnot_si128(k, v));
+    }
+}
+
+__attribute__((target("avx2"))) static void
+tag_match_avx2(const int *fields, int count, int key, unsigned long long *mask)
+{
+    __m256i k = _mm256_set1_epi32(key);
+
+    for (int i = 0; i < count; i += 64)
+    {
+        unsigned long long bits = 0;
+        for (int j = 0; j < 64; j += 8)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)&fields[i + j]);
+            int m = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, k)));
+            bits |= (unsigned long long)m << j;
+        }
+        mask[i / 64] = bits;
+    }
+}
+
+__attribute__((target("avx2"))) static void
+mask_match_avx2(const int *fields, int count, int key, unsigned long long *mask)
+{
+    __m256i k = _mm256_set1_epi32(key);
+    __m256i zero = _mm256_setzero_si256();
+
+    for (int i = 0; i < count; i += 64)
+    {
+        unsigned long long bits = 0;
+        for (int j = 0; j < 64; j += 8)
+        {
+            __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&fields[i + j]), k);
+            int m = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, zero)));
+            bits |= (unsigned long long)(~m & 0xff) << j;
+        }
+        mask[i / 64] = bits;
+    }
+}
+
+__attribute__((target("avx2"))) static void
+mask_clear_avx2(int *fields, int count, int bits)
+{
+    __m256i k = _mm256_set1_epi32(bits);
+
+    for (int i = 0; i < count; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&fields[i]);
+        _mm256_storeu_si256((__m256i *)&fields[i], _mm256_andnot_si256(k, v));
+    }
+}
+#endif
+
+tag_match_fn tag_match = tag_match_scalar;
+mask_match_fn mask_match = mask_match_scalar;
+mask_clear_fn mask_clear = mask_clear_scalar;
+static const char *tag_match_name = "scalar";
+
+void
+apex_simd_init(void)
+{
+#ifdef APEX_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        tag_match = tag_match_avx2;
+        mask_match = mask_match_avx2;
+        mask_clear = mask_clear_avx2;
+        tag_match_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        tag_match = tag_match_sse2;
+        mask_match = mask_match_sse2;
+        mask_clear = mask_clear_sse2;
+        tag_match_name = "sse2";
+    }
+#endif
+}
+
+const char *
+apex_simd_name(void)
+{
+    return tag_match_name;
+}
@@ -0,0 +1,38 @@
+/*
+ * apex_simd.h
+ * Contains the associative tag-match and branch-mask kernels used by the
+ * issue queue
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_SIMD_H_
+#define _APEX_SIMD_H_
+
+/*
+ * Compares count ints of fields against key and sets bit i of mask[i / 64]
+ * when fields[i] == key. count is a multiple of 64; fields is read with
+ * unaligned loads, so it needs no more than int alignment.
+ */
+typedef void (*tag_match_fn)(const int *fields, int count, int key,
+                             unsigned long long *mask);
+
+/*
+ * Same layout as tag_match, but sets bit i when fields[i] & bits is non-zero.
+ * Used to find every instruction that depends on a given branch.
+ */
+typedef void (*mask_match_fn)(const int *fields, int count, int bits,
+                              unsigned long long *mask);
+
+/* Clears bits in each of count ints of fields */
+typedef void (*mask_clear_fn)(int *fields, int count, int bits);
+
+extern tag_match_fn tag_match;
+extern mask_match_fn mask_match;
+extern mask_clear_fn mask_clear;
+
+void apex_simd_init(void);
+const char *apex_simd_name(void);
+
+#endif
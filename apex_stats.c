@@ -0,0 +1,189 @@
+/*
+ * apex_stats.c
+ * Contains the report and the JSON dump of the performance counters
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+
+#include "apex_mem.h"
+#include "apex_stats.h"
+#include "apex_stream.h"
+
+#define APEX_STALL_LABEL(name, label) label,
+static const char *const stall_labels[NUM_STALLS] = {APEX_STALL_TABLE(APEX_STALL_LABEL)};
+
+#define APEX_L1D_LABEL(name, label) label,
+static const char *const l1d_labels[NUM_L1D_OUTCOMES] = {APEX_L1D_TABLE(APEX_L1D_LABEL)};
+
+static double
+ratio(unsigned long long num, unsigned long long den)
+{
+    return den ? (double)num / den : 0.0;
+}
+
+static double
+histogram_mean(const unsigned long long *bins, int n)
+{
+    unsigned long long total = 0, weighted = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        total += bins[i];
+        weighted += bins[i] * i;
+    }
+    return ratio(weighted, total);
+}
+
+/* Prints the non-empty bins as occupancy:share-of-cycles pairs */
+static void
+print_histogram(const char *name, const unsigned long long *bins, int n, unsigned long long cycles)
+{
+    int max = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (bins[i])
+        {
+            max = i;
+        }
+    }
+    apex_printf("   %-16s mean %.2f, max %d\n", name, histogram_mean(bins, n), max);
+    apex_printf("   %-16s", "");
+    for (int i = 0, col = 0; i <= max; i++)
+    {
+        if (!bins[i])
+        {
+            continue;
+        }
+        if (col++ == 6)
+        {
+            apex_printf("\n   %-16s", "");
+            col = 1;
+        }
+        apex_printf(" %3d:%5.1f%%", i, 100.0 * ratio(bins[i], cycles));
+    }
+    apex_printf("\n");
+}
+
+void
+apex_stats_print(const APEX_Stats *stats)
+{
+    unsigned long long stalled = 0;
+
+    for (int i = 0; i < NUM_STALLS; i++)
+    {
+        stalled += stats->dispatch_stalls[i];
+    }
+    apex_printf("----------------------------------------\n%s\n----------------------------------------\n", " PERFORMANCE COUNTERS");
+    apex_printf("   %-16s %llu\n", "cycles", stats->cycles);
+    apex_printf("   %-16s %llu\n", "instructions", stats->instructions);
+    apex_printf("   %-16s %.3f\n", "IPC", ratio(stats->instructions, stats->cycles));
+    apex_printf("   %-16s %llu (%.1f%%)\n", "dispatch stalls", stalled, 100.0 * ratio(stalled, stats->cycles));
+    for (int i = 0; i < NUM_STALLS; i++)
+    {
+        apex_printf("     %-14s %llu\n", stall_labels[i], stats->dispatch_stalls[i]);
+    }
+    apex_printf("   FU busy cycles\n");
+    for (int i = 0; i < stats->num_units; i++)
+    {
+        apex_printf("     %-14s %llu (%.1f%%)\n", stats->unit_names[i], stats->unit_busy[i],
+                    100.0 * ratio(stats->unit_busy[i], stats->cycles));
+    }
+    apex_printf("   %-16s %s\n", "issue select", stats->select_policy);
+    apex_printf("   %-16s %s\n", "predictor", stats->predictor);
+    apex_printf("   %-16s %llu\n", "branches", stats->branches);
+    apex_printf("   %-16s %llu (accuracy %.1f%%)\n", "mispredicts", stats->mispredicts,
+                100.0 * (1.0 - ratio(stats->mispredicts, stats->branches)));
+    apex_printf("   %-16s %llu\n", "branch flushes", stats->branch_flushes);
+    apex_printf("   %-16s %llu\n", "squashed", stats->squashed);
+    apex_printf("   %-16s %llu\n", "store forwards", stats->store_forwards);
+    apex_printf("   %-16s %llu\n", "load replays", stats->load_replays);
+    apex_printf("   %-16s %s\n", "L1D", stats->l1d ? stats->l1d : "off");
+    for (int i = 0; stats->l1d && i < NUM_L1D_OUTCOMES; i++)
+    {
+        apex_printf("     %-14s %llu\n", l1d_labels[i], stats->l1d_accesses[i]);
+    }
+    apex_printf("   %-16s %s\n", "prefetcher", stats->prefetcher ? stats->prefetcher : "off");
+    if (stats->prefetcher)
+    {
+        // useful prefetches are the ones a load or store wanted, in time or not
+        unsigned long long timely = stats->l1d_accesses[L1D_PREFETCH_HIT];
+        unsigned long long useful = timely + stats->l1d_accesses[L1D_PREFETCH_LATE];
+
+        apex_printf("     %-14s %llu\n", "issued", stats->prefetches);
+        apex_printf("     %-14s %.1f%%\n", "accuracy", 100.0 * ratio(useful, stats->prefetches));
+        apex_printf("     %-14s %.1f%%\n", "coverage",
+                    100.0 * ratio(useful, useful + stats->l1d_accesses[L1D_MISS]));
+        apex_printf("     %-14s %.1f%%\n", "timeliness", 100.0 * ratio(timely, useful));
+    }
+    apex_printf("   %-16s %llu (%llu KB)\n", "page faults", stats->page_faults,
+                stats->page_faults * MEM_PAGE_WORDS * sizeof(int) / 1024);
+    print_histogram("IQ occupancy", stats->iq_occupancy, IQ_SIZE + 1, stats->cycles);
+    print_histogram("ROB occupancy", stats->rob_occupancy, ROB_SIZE, stats->cycles);
+    apex_printf("\n");
+}
+
+static void
+dump_array(FILE *file, const char *name, const unsigned long long *values, int n)
+{
+    fprintf(file, "  \"%s\": [", name);
+    for (int i = 0; i < n; i++)
+    {
+        fprintf(file, "%s%llu", i ? ", " : "", values[i]);
+    }
+    fprintf(file, "]");
+}
+
+/* Writes the counters as one JSON object, histograms indexed by occupancy */
+int
+apex_stats_dump(const APEX_Stats *stats, const char *path)
+{
+    FILE *file = fopen(path, "w");
+
+    if (!file)
+    {
+        return -1;
+    }
+    fprintf(file, "{\n");
+    fprintf(file, "  \"cycles\": %llu,\n", stats->cycles);
+    fprintf(file, "  \"instructions\": %llu,\n", stats->instructions);
+    fprintf(file, "  \"ipc\": %.6f,\n", ratio(stats->instructions, stats->cycles));
+    fprintf(file, "  \"dispatch_stalls\": {");
+    for (int i = 0; i < NUM_STALLS; i++)
+    {
+        fprintf(file, "%s\"%s\": %llu", i ? ", " : "", stall_labels[i], stats->dispatch_stalls[i]);
+    }
+    fprintf(file, "},\n");
+    fprintf(file, "  \"unit_busy\": {");
+    for (int i = 0; i < stats->num_units; i++)
+    {
+        fprintf(file, "%s\"%s\": %llu", i ? ", " : "", stats->unit_names[i], stats->unit_busy[i]);
+    }
+    fprintf(file, "},\n");
+    fprintf(file, "  \"select_policy\": \"%s\",\n", stats->select_policy);
+    fprintf(file, "  \"predictor\": \"%s\",\n", stats->predictor);
+    fprintf(file, "  \"branches\": %llu,\n", stats->branches);
+    fprintf(file, "  \"mispredicts\": %llu,\n", stats->mispredicts);
+    fprintf(file, "  \"branch_flushes\": %llu,\n", stats->branch_flushes);
+    fprintf(file, "  \"squashed\": %llu,\n", stats->squashed);
+    fprintf(file, "  \"store_forwards\": %llu,\n", stats->store_forwards);
+    fprintf(file, "  \"load_replays\": %llu,\n", stats->load_replays);
+    fprintf(file, "  \"l1d\": \"%s\",\n", stats->l1d ? stats->l1d : "off");
+    fprintf(file, "  \"l1d_accesses\": {");
+    for (int i = 0; i < NUM_L1D_OUTCOMES; i++)
+    {
+        fprintf(file, "%s\"%s\": %llu", i ? ", " : "", l1d_labels[i], stats->l1d_accesses[i]);
+    }
+    fprintf(file, "},\n");
+    fprintf(file, "  \"prefetcher\": \"%s\",\n", stats->prefetcher ? stats->prefetcher : "off");
+    fprintf(file, "  \"prefetches\": %llu,\n", stats->prefetches);
+    fprintf(file, "  \"page_faults\": %llu,\n", stats->page_faults);
+    dump_array(file, "iq_occupancy", stats->iq_occupancy, IQ_SIZE + 1);
+    fprintf(file, ",\n");
+    dump_array(file, "rob_occupancy", stats->rob_occupancy, ROB_SIZE);
+    fprintf(file, "\n}\n");
+    return fclose(file);
+}
@@ -0,0 +1,60 @@
+/*
+ * apex_stats.h
+ * Contains the performance counters kept by the pipeline and reported at
+ * the end of a run
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_STATS_H_
+#define _APEX_STATS_H_
+
+#include "apex_cache.h"
+#include "apex_macros.h"
+
+/* Reasons decode holds an instruction back, X(name, label), checked in this
+ * order so a cycle is charged to the first one that applies */
+#define APEX_STALL_TABLE(X)       \
+    X(IQ_FULL, "iq_full")         \
+    X(ROB_FULL, "rob_full")       \
+    X(NO_FREE_REG, "no_free_reg") \
+    X(BIS_FULL, "bis_full")       \
+    X(LSQ_FULL, "lsq_full")
+
+#define APEX_STALL_ENUM(name, label) STALL_##name,
+enum
+{
+    APEX_STALL_TABLE(APEX_STALL_ENUM)
+    NUM_STALLS
+};
+
+typedef struct APEX_Stats
+{
+    unsigned long long cycles;
+    unsigned long long instructions;
+    unsigned long long dispatch_stalls[NUM_STALLS]; /* cycles decode held an instruction */
+    int num_units;                                  /* units in the FU pool */
+    const char *unit_names[MAX_FUS];
+    unsigned long long unit_busy[MAX_FUS];          /* cycles the unit held an instruction */
+    const char *select_policy;                      /* how issue ports pick */
+    const char *predictor;                          /* name of the branch predictor */
+    unsigned long long branches;                    /* committed control transfers */
+    unsigned long long mispredicts;                 /* of them, the ones fetch got wrong */
+    unsigned long long branch_flushes;              /* mispredicts, also on squashed paths */
+    unsigned long long squashed;                    /* instructions thrown away by them */
+    unsigned long long store_forwards;              /* loads given an older store's data */
+    unsigned long long load_replays;                /* loads squashed for reading too early */
+    const char *l1d;                                /* L1D geometry, NULL without one */
+    unsigned long long l1d_accesses[NUM_L1D_OUTCOMES]; /* loads and stores by what they found */
+    const char *prefetcher;                         /* prefetcher setup, NULL without one */
+    unsigned long long prefetches;                  /* line fills it started */
+    unsigned long long page_faults;                 /* first writes to a data memory page, which allocate it */
+    unsigned long long iq_occupancy[IQ_SIZE + 1];   /* cycles with n IQ entries live */
+    unsigned long long rob_occupancy[ROB_SIZE];     /* cycles with n ROB entries live */
+} APEX_Stats;
+
+void apex_stats_print(const APEX_Stats *stats);
+int apex_stats_dump(const APEX_Stats *stats, const char *path);
+
+#endif
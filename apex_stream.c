@@ -0,0 +1,270 @@
+/*
+ * apex_stream.c
+ * Contains the writer thread behind APEX_Stream and the printf front end
+ * used by the simulator's text output
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <sched.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "apex_lz.h"
+#include "apex_macros.h"
+#include "apex_stream.h"
+
+APEX_Stream *apex_out;
+
+static unsigned long long
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+idle_wait(void)
+{
+    struct timespec ts = {0, 200000};
+    nanosleep(&ts, NULL);
+}
+
+/* Writes one chunk, as an LZ block when the stream compresses */
+static void
+write_chunk(APEX_Stream *stream, const unsigned char *data, size_t len, unsigned char *block)
+{
+    if (stream->compress)
+    {
+        uint32_t header[2] = {(uint32_t)len, (uint32_t)len};
+        size_t packed = apex_lz_compress(data, len, block, len - 1);
+
+        if (packed)
+        {
+            header[1] = (uint32_t)packed;
+            data = block;
+        }
+        fwrite(header, sizeof(header), 1, stream->file);
+        fwrite(data, 1, header[1], stream->file);
+        stream->bytes_out += sizeof(header) + header[1];
+    }
+    else
+    {
+        fwrite(data, 1, len, stream->file);
+        stream->bytes_out += len;
+    }
+    stream->batches++;
+}
+
+static void *
+writer_thread(void *arg)
+{
+    APEX_Stream *stream = arg;
+    unsigned char *batch = stream->batch;
+
+    while (TRUE)
+    {
+        size_t tail = atomic_load_explicit(&stream->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&stream->head, memory_order_acquire);
+        int draining = atomic_load(&stream->flushing) || atomic_load(&stream->closing);
+        size_t len = head - tail;
+
+        if (len == 0 && draining)
+        {
+            fflush(stream->file);
+            if (atomic_load(&stream->closing))
+            {
+                break;
+            }
+        }
+        // full batches keep both the wakeups and the LZ block headers rare
+        if (len == 0 || (len < APEX_STREAM_BATCH && !draining))
+        {
+            idle_wait();
+            continue;
+        }
+        if (len > APEX_STREAM_BATCH)
+        {
+            len = APEX_STREAM_BATCH;
+        }
+        for (size_t i = 0, start = tail & (APEX_STREAM_SIZE - 1); i < len;)
+        {
+            size_t piece = len - i < APEX_STREAM_SIZE - start ? len - i : APEX_STREAM_SIZE - start;
+            memcpy(batch + i, &stream->ring[start], piece);
+            i += piece;
+            start = 0;
+        }
+        // the ring space is handed back before the slow part
+        atomic_store_explicit(&stream->tail, tail + len, memory_order_release);
+        write_chunk(stream, batch, len, stream->block);
+        atomic_store_explicit(&stream->written, tail + len, memory_order_release);
+    }
+    return NULL;
+}
+
+APEX_Stream *
+apex_stream_open(FILE *file, const char *name, int compress)
+{
+    APEX_Stream *stream = aligned_alloc(64, sizeof(APEX_Stream));
+
+    if (!stream)
+    {
+        return NULL;
+    }
+    memset(stream, 0, sizeof(APEX_Stream));
+    stream->batch = malloc(APEX_STREAM_BATCH);
+    stream->block = malloc(APEX_STREAM_BATCH);
+    if (!stream->batch || !stream->block)
+    {
+        free(stream->batch);
+        free(stream->block);
+        free(stream);
+        return NULL;
+    }
+    stream->file = file;
+    stream->name = name;
+    stream->compress = compress;
+    if (compress)
+    {
+        uint32_t magic = APEX_LZ_MAGIC;
+        fwrite(&magic, sizeof(magic), 1, file);
+    }
+    if (pthread_create(&stream->writer, NULL, writer_thread, stream) != 0)
+    {
+        free(stream->batch);
+        free(stream->block);
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+/* Waits for the writer to free len bytes of the ring */
+static void
+wait_for_room(APEX_Stream *stream, size_t len)
+{
+    size_t head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+    unsigned long long start = 0;
+
+    while (TRUE)
+    {
+        stream->cached_tail = atomic_load_explicit(&stream->tail, memory_order_acquire);
+        if (APEX_STREAM_SIZE - (head - stream->cached_tail) >= len)
+        {
+            break;
+        }
+        if (!start)
+        {
+            start = now_ns();
+            stream->full_waits++;
+        }
+        sched_yield();
+    }
+    if (start)
+    {
+        stream->wait_ns += now_ns() - start;
+    }
+}
+
+/* Largest piece the slow path waits for room for. The writer leaves less
+ * than a batch in the ring until more arrives, so a wait for more room
+ * than the rest of the ring would never end */
+#define SLOW_PIECE (APEX_STREAM_SIZE - APEX_STREAM_BATCH)
+
+/* Slow path of apex_stream_write: the ring is full, or len is more than it
+ * can ever take at once, so it goes in pieces as the writer frees room */
+void
+apex_stream_write_slow(APEX_Stream *stream, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    while (len)
+    {
+        size_t piece = len < SLOW_PIECE ? len : SLOW_PIECE;
+
+        wait_for_room(stream, piece);
+        apex_stream_put(stream, p, piece);
+        p += piece;
+        len -= piece;
+    }
+}
+
+/* Returns once everything appended so far has reached the file */
+void
+apex_stream_flush(APEX_Stream *stream)
+{
+    if (!stream)
+    {
+        return;
+    }
+    atomic_store(&stream->flushing, TRUE);
+    while (atomic_load_explicit(&stream->written, memory_order_acquire) !=
+           atomic_load_explicit(&stream->head, memory_order_relaxed))
+    {
+        sched_yield();
+    }
+    atomic_store(&stream->flushing, FALSE);
+    fflush(stream->file);
+}
+
+void
+apex_stream_close(APEX_Stream *stream)
+{
+    if (!stream)
+    {
+        return;
+    }
+    atomic_store(&stream->closing, TRUE);
+    pthread_join(stream->writer, NULL);
+    if (stream->full_waits || stream->compress)
+    {
+        fprintf(stderr,
+                "APEX_STREAM: %s: %llu bytes in, %llu out in %llu batches, "
+                "simulator waited %llu times (%.3f ms)\n",
+                stream->name, stream->bytes_in, stream->bytes_out, stream->batches,
+                stream->full_waits, stream->wait_ns / 1e6);
+    }
+    free(stream->batch);
+    free(stream->block);
+    free(stream);
+}
+
+void
+apex_printf(const char *format, ...)
+{
+    char buf[512];
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    if (!apex_out)
+    {
+        vprintf(format, args);
+        va_end(args);
+        return;
+    }
+    len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len >= (int)sizeof(buf))
+    {
+        char *big = malloc(len + 1);
+
+        if (!big)
+        {
+            return;
+        }
+        va_start(args, format);
+        vsnprintf(big, len + 1, format, args);
+        va_end(args);
+        apex_stream_write(apex_out, big, len);
+        free(big);
+    }
+    else if (len > 0)
+    {
+        apex_stream_write(apex_out, buf, len);
+    }
+}
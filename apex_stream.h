@@ -0,0 +1,98 @@
+/*
+ * apex_stream.h
+ * Contains the asynchronous output stream: the simulation thread appends
+ * bytes to a single-producer/single-consumer ring and a writer thread
+ * batches them, optionally compresses them, and writes them out
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_STREAM_H_
+#define _APEX_STREAM_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Ring capacity in bytes, a power of two */
+#ifndef APEX_STREAM_SIZE
+#define APEX_STREAM_SIZE (1 << 20)
+#endif
+#if APEX_STREAM_SIZE & (APEX_STREAM_SIZE - 1)
+#error "APEX_STREAM_SIZE must be a power of two"
+#endif
+
+/* Bytes the writer gathers before it writes, or encodes, a block */
+#define APEX_STREAM_BATCH (64 * 1024)
+#if APEX_STREAM_SIZE <= APEX_STREAM_BATCH
+#error "APEX_STREAM_SIZE must be larger than APEX_STREAM_BATCH"
+#endif
+
+typedef struct APEX_Stream
+{
+    unsigned char ring[APEX_STREAM_SIZE];
+    FILE *file;
+    const char *name;
+    int compress;
+    pthread_t writer;
+    _Atomic int flushing; /* producer is waiting for the ring to empty */
+    _Atomic int closing;
+
+    /* Each side's index and counters share a cache line of their own, so
+     * the two threads only touch each other's line to read the index */
+    _Alignas(64) _Atomic size_t head; /* written by the simulation thread only */
+    size_t cached_tail;               /* producer's last look at tail */
+    unsigned long long full_waits;    /* appends that found the ring full */
+    unsigned long long wait_ns;       /* time the simulation thread spent waiting */
+    unsigned long long bytes_in;
+
+    _Alignas(64) _Atomic size_t tail; /* written by the writer thread only */
+    _Atomic size_t written;           /* bytes the writer has passed to the file */
+    unsigned char *batch;             /* APEX_STREAM_BATCH bytes taken off the ring */
+    unsigned char *block;             /* the same, LZ encoded */
+    unsigned long long bytes_out;
+    unsigned long long batches;
+} APEX_Stream;
+
+/* Everything APEX_cpu_run and the print helpers emit goes here when it is
+ * open, to stdout directly otherwise */
+extern APEX_Stream *apex_out;
+
+APEX_Stream *apex_stream_open(FILE *file, const char *name, int compress);
+void apex_stream_write_slow(APEX_Stream *stream, const void *data, size_t len);
+void apex_stream_flush(APEX_Stream *stream);
+void apex_stream_close(APEX_Stream *stream);
+void apex_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/* Appends len bytes the ring has room for */
+static inline void
+apex_stream_put(APEX_Stream *stream, const void *data, size_t len)
+{
+    size_t head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+    size_t start = head & (APEX_STREAM_SIZE - 1);
+    size_t first = len < APEX_STREAM_SIZE - start ? len : APEX_STREAM_SIZE - start;
+
+    memcpy(&stream->ring[start], data, first);
+    memcpy(&stream->ring[0], (const unsigned char *)data + first, len - first);
+    stream->bytes_in += len;
+    atomic_store_explicit(&stream->head, head + len, memory_order_release);
+}
+
+/* Producer side: a copy and a release store unless the ring is full */
+static inline void
+apex_stream_write(APEX_Stream *stream, const void *data, size_t len)
+{
+    size_t head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+
+    if (APEX_STREAM_SIZE - (head - stream->cached_tail) < len)
+    {
+        apex_stream_write_slow(stream, data, len);
+        return;
+    }
+    apex_stream_put(stream, data, len);
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * apex_trace.c
+ * Contains the writer side of the binary event trace and lifetime files
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_trace.h"
+
+/* Creates the trace file and queues the header and program for it */
+APEX_Trace *
+apex_trace_open(const char *path, uint32_t magic, const APEX_Instruction *code, int code_size,
+                int compress)
+{
+    APEX_Trace *trace = calloc(1, sizeof(APEX_Trace));
+    APEX_Trace_Header header = {magic, APEX_TRACE_VERSION, code_size};
+
+    if (!trace)
+    {
+        return NULL;
+    }
+    trace->file = fopen(path, "wb");
+    if (!trace->file)
+    {
+        free(trace);
+        return NULL;
+    }
+    trace->stream = apex_stream_open(trace->file, path, compress);
+    if (!trace->stream)
+    {
+        fclose(trace->file);
+        free(trace);
+        return NULL;
+    }
+    apex_stream_write(trace->stream, &header, sizeof(header));
+    for (int i = 0; i < code_size; i++)
+    {
+        APEX_Trace_Insn insn = {code[i].opcode, code[i].rd, code[i].rs1,
+                                code[i].rs2, code[i].rs3, code[i].imm};
+        apex_stream_write(trace->stream, &insn, sizeof(insn));
+    }
+    return trace;
+}
+
+void
+apex_trace_close(APEX_Trace *trace)
+{
+    if (!trace)
+    {
+        return;
+    }
+    apex_stream_close(trace->stream);
+    fclose(trace->file);
+    free(trace);
+}
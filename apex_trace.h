@@ -0,0 +1,141 @@
+/*
+ * apex_trace.h
+ * Contains the binary pipeline event trace written by the simulator and
+ * read back by apex_trace_conv
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "apex_cpu.h"
+#include "apex_stream.h"
+
+/*
+ * File layout: an APEX_Trace_Header, header.code_size APEX_Trace_Insn
+ * records holding the program, then the records. An event trace holds
+ * APEX_Trace_Event records in the order they happened; every instruction
+ * gets a sequence number when it leaves fetch, starting at 0, and all its
+ * events carry it. A lifetime file (--timestamps) holds one
+ * APEX_Trace_Lifetime per committed instruction, in commit order. With
+ * --trace-lz the whole file is wrapped in apex_lz blocks.
+ */
+#define APEX_TRACE_MAGIC 0x54585041    /* "APXT" */
+#define APEX_LIFETIME_MAGIC 0x4c585041 /* "APXL" */
+#define APEX_TRACE_VERSION 1
+
+/* Events, X(name, label); the label is what the converter prints */
+#define APEX_TRACE_EVENT_TABLE(X)     \
+    X(FETCH, "Fetch")                 \
+    X(DISPATCH, "Dispatch")           \
+    X(ISSUE, "Issue")                 \
+    X(FU_START, "FU start")           \
+    X(FU_END, "FU end")               \
+    X(WRITEBACK, "Writeback")         \
+    X(COMMIT, "Commit")               \
+    X(SQUASH, "Squash")
+
+#define APEX_TRACE_EVENT_ENUM(name, label) EV_##name,
+enum
+{
+    APEX_TRACE_EVENT_TABLE(APEX_TRACE_EVENT_ENUM)
+    NUM_TRACE_EVENTS
+};
+
+typedef struct APEX_Trace_Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t code_size;
+} APEX_Trace_Header;
+
+typedef struct APEX_Trace_Insn
+{
+    int32_t opcode, rd, rs1, rs2, rs3, imm;
+} APEX_Trace_Insn;
+
+typedef struct APEX_Trace_Event
+{
+    uint32_t cycle;
+    uint32_t seq;
+    uint16_t pc_index; /* code memory index, pc = 4000 + 4 * pc_index */
+    uint8_t type;      /* EV_* */
+    uint8_t arg;       /* FU_* class for FU_START/FU_END, 0 otherwise */
+} APEX_Trace_Event;
+
+typedef struct APEX_Trace_Lifetime
+{
+    uint32_t seq;
+    uint16_t pc_index;
+    uint16_t redirected; /* fetch restarted after it, see ROB_SLOT */
+    int32_t mem_addr;    /* effective address of a load or store, 0 otherwise */
+    INSN_TIMES times;
+} APEX_Trace_Lifetime;
+
+/* Events go through an APEX_Stream, so the file is written, and
+ * compressed, on the stream's writer thread */
+typedef struct APEX_Trace
+{
+    FILE *file;
+    APEX_Stream *stream;
+} APEX_Trace;
+
+APEX_Trace *apex_trace_open(const char *path, uint32_t magic, const APEX_Instruction *code,
+                            int code_size, int compress);
+void apex_trace_close(APEX_Trace *trace);
+
+/* Kept inline so that recording is a few stores into the stream ring */
+static inline void
+apex_trace_emit(APEX_Trace *trace, int type, int cycle, int seq, int pc, int arg)
+{
+    APEX_Trace_Event event;
+
+    event.cycle = cycle;
+    event.seq = seq;
+    event.pc_index = (pc - 4000) / 4;
+    event.type = type;
+    event.arg = arg;
+    apex_stream_write(trace->stream, &event, sizeof(event));
+}
+
+/* Called at commit with the entry's times complete */
+static inline void
+apex_trace_lifetime(APEX_Trace *trace, const ROB_SLOT *slot)
+{
+    APEX_Trace_Lifetime record;
+
+    record.seq = slot->seq;
+    record.pc_index = (slot->pc - 4000) / 4;
+    record.redirected = slot->redirected;
+    record.mem_addr = slot->calc_mem_add;
+    record.times = slot->times;
+    apex_stream_write(trace->stream, &record, sizeof(record));
+}
+
+/*
+ * Reader side, used by the offline tools. Compressed files are decoded on
+ * the fly, so callers only see the plain layout.
+ */
+typedef struct APEX_Trace_Reader
+{
+    FILE *file;
+    int compressed;
+    uint8_t *block; /* decoded bytes of the current block */
+    uint8_t *packed;
+    size_t len;
+    size_t pos;
+    APEX_Trace_Insn *code;
+    uint32_t code_size;
+} APEX_Trace_Reader;
+
+int apex_trace_reader_open(APEX_Trace_Reader *reader, const char *path, uint32_t magic);
+size_t apex_trace_read(APEX_Trace_Reader *reader, void *buf, size_t n);
+void apex_trace_reader_close(APEX_Trace_Reader *reader);
+void apex_trace_format_insn(const APEX_Trace_Insn *insn, char *buf, size_t size);
+
+#endif
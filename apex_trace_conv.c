@@ -0,0 +1,225 @@
+/*
+ * apex_trace_conv.c
+ * Renders a binary event trace written with --event-trace as a per-cycle
+ * text listing, a Konata (Kanata log) pipeline diagram or Chrome trace JSON.
+ * Traces compressed with --trace-lz are decoded on the fly.
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_trace.h"
+
+/* Instructions in flight at once, far more than the ROB holds */
+#define WINDOW 4096
+
+#define APEX_TRACE_EVENT_LABEL(name, label) label,
+static const char *event_labels[] = {APEX_TRACE_EVENT_TABLE(APEX_TRACE_EVENT_LABEL)};
+
+/* Pipeline diagram stage an instruction enters with each event, NULL when
+ * the event does not move it */
+static const char *event_stages[NUM_TRACE_EVENTS] = {
+    [EV_FETCH] = "F",
+    [EV_DISPATCH] = "Ds",
+    [EV_ISSUE] = "Is",
+    [EV_FU_START] = "X",
+    [EV_FU_END] = "Cm",
+};
+
+typedef struct Insn_State
+{
+    const char *stage; /* stage the instruction is in, NULL once retired */
+    uint32_t stage_start;
+    int pc_index;
+    int lane;
+} Insn_State;
+
+typedef struct Converter
+{
+    APEX_Trace_Insn *code;
+    uint32_t code_size;
+    char (*text)[64]; /* disassembly of each code memory entry */
+    Insn_State window[WINDOW];
+    char lane_busy[WINDOW];
+    uint32_t cycle;
+    uint32_t retired;
+    uint32_t emitted; /* chrome records written, for the separators */
+    int started;
+} Converter;
+
+static const char *
+insn_text(const Converter *conv, int pc_index)
+{
+    return pc_index < (int)conv->code_size ? conv->text[pc_index] : "???";
+}
+
+static void
+text_event(Converter *conv, const APEX_Trace_Event *event)
+{
+    if (!conv->started || event->cycle != conv->cycle)
+    {
+        printf("--------------------------------------------\n");
+        printf("Clock Cycle #: %u\n", event->cycle);
+        printf("--------------------------------------------\n");
+    }
+    printf("%-15s: pc(%-4d) %s\n", event_labels[event->type], 4000 + 4 * event->pc_index,
+           insn_text(conv, event->pc_index));
+}
+
+static void
+konata_event(Converter *conv, const APEX_Trace_Event *event)
+{
+    Insn_State *insn = &conv->window[event->seq % WINDOW];
+    const char *stage = event_stages[event->type];
+
+    if (!conv->started)
+    {
+        printf("Kanata\t0004\nC=\t%u\n", event->cycle);
+    }
+    else if (event->cycle != conv->cycle)
+    {
+        printf("C\t%u\n", event->cycle - conv->cycle);
+    }
+    if (event->type == EV_FETCH)
+    {
+        printf("I\t%u\t%u\t0\n", event->seq, event->seq);
+        printf("L\t%u\t0\t%d: %s\n", event->seq, 4000 + 4 * event->pc_index,
+               insn_text(conv, event->pc_index));
+        insn->stage = NULL;
+    }
+    if ((stage || event->type == EV_COMMIT) && insn->stage)
+    {
+        printf("E\t%u\t0\t%s\n", event->seq, insn->stage);
+    }
+    if (stage)
+    {
+        printf("S\t%u\t0\t%s\n", event->seq, stage);
+        insn->stage = stage;
+    }
+    if (event->type == EV_COMMIT || event->type == EV_SQUASH)
+    {
+        printf("R\t%u\t%u\t%d\n", event->seq, event->type == EV_COMMIT ? conv->retired++ : 0,
+               event->type == EV_SQUASH);
+        insn->stage = NULL;
+    }
+}
+
+/* Each instruction gets the lowest lane free from its fetch to its retire,
+ * so the boxes of one row never overlap */
+static void
+chrome_stage(Converter *conv, Insn_State *insn, uint32_t seq, uint32_t end)
+{
+    printf("%s{\"name\":\"%s %s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%u,\"dur\":%u,"
+           "\"pid\":1,\"tid\":%d,\"args\":{\"seq\":%u,\"pc\":%d}}",
+           conv->emitted++ ? ",\n" : "\n", insn->stage, insn_text(conv, insn->pc_index),
+           insn->stage, insn->stage_start, end - insn->stage_start, insn->lane, seq,
+           4000 + 4 * insn->pc_index);
+}
+
+static void
+chrome_event(Converter *conv, const APEX_Trace_Event *event)
+{
+    Insn_State *insn = &conv->window[event->seq % WINDOW];
+    const char *stage = event_stages[event->type];
+
+    if (!conv->started)
+    {
+        printf("{\"traceEvents\":[");
+    }
+    if (event->type == EV_FETCH)
+    {
+        insn->lane = 0;
+        while (conv->lane_busy[insn->lane])
+        {
+            insn->lane++;
+        }
+        conv->lane_busy[insn->lane] = TRUE;
+        insn->pc_index = event->pc_index;
+        insn->stage = NULL;
+    }
+    if ((stage || event->type == EV_COMMIT || event->type == EV_SQUASH) && insn->stage)
+    {
+        chrome_stage(conv, insn, event->seq, event->cycle);
+    }
+    insn->stage = stage ? stage : insn->stage;
+    insn->stage_start = stage ? event->cycle : insn->stage_start;
+    if (event->type == EV_COMMIT || event->type == EV_SQUASH)
+    {
+        conv->lane_busy[insn->lane] = FALSE;
+        insn->stage = NULL;
+    }
+}
+
+int
+main(int argc, char const *argv[])
+{
+    APEX_Trace_Event events[1024];
+    Converter *conv;
+    void (*convert)(Converter *, const APEX_Trace_Event *) = text_event;
+    const char *format = argc > 2 ? argv[2] : "text";
+    APEX_Trace_Reader reader;
+    size_t count;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "APEX_Help: Usage apex_trace_conv {trace_file} {text|konata|chrome}\n");
+        exit(1);
+    }
+    if (strcmp(format, "konata") == 0)
+    {
+        convert = konata_event;
+    }
+    else if (strcmp(format, "chrome") == 0)
+    {
+        convert = chrome_event;
+    }
+    else if (strcmp(format, "text") != 0)
+    {
+        fprintf(stderr, "APEX_Error: unknown format %s\n", format);
+        exit(1);
+    }
+
+    if (!apex_trace_reader_open(&reader, argv[1], APEX_TRACE_MAGIC))
+    {
+        exit(1);
+    }
+
+    conv = calloc(1, sizeof(Converter));
+    conv->code = reader.code;
+    conv->code_size = reader.code_size;
+    conv->text = calloc(reader.code_size + 1, sizeof(*conv->text));
+    for (uint32_t i = 0; i < reader.code_size; i++)
+    {
+        apex_trace_format_insn(&conv->code[i], conv->text[i], sizeof(conv->text[i]));
+    }
+
+    while ((count = apex_trace_read(&reader, events, sizeof(events)) / sizeof(APEX_Trace_Event)) > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (events[i].type >= NUM_TRACE_EVENTS)
+            {
+                fprintf(stderr, "APEX_Error: bad event type %d\n", events[i].type);
+                exit(1);
+            }
+            convert(conv, &events[i]);
+            conv->cycle = events[i].cycle;
+            conv->started = TRUE;
+        }
+    }
+    if (convert == chrome_event)
+    {
+        printf("%s]}\n", conv->started ? "\n" : "{\"traceEvents\":[");
+    }
+
+    apex_trace_reader_close(&reader);
+    free(conv->text);
+    free(conv);
+    return 0;
+}
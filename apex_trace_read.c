@@ -0,0 +1,179 @@
+/*
+ * apex_trace_read.c
+ * Contains the reader side of the binary trace files, shared by
+ * apex_trace_conv and apex_cpi
+ *
+ * Author:
+ * Copyright (c) 2020, Kamal Kumawat (kkumawa1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_lz.h"
+#include "apex_macros.h"
+#include "apex_trace.h"
+
+/* Grows a block buffer to size bytes, the old one stays with the reader
+ * if that fails */
+static void
+grow_buffer(uint8_t **buf, uint32_t size)
+{
+    uint8_t *grown = realloc(*buf, size ? size : 1);
+
+    if (!grown)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate a %u byte block\n", size);
+        exit(1);
+    }
+    *buf = grown;
+}
+
+static int
+next_block(APEX_Trace_Reader *reader)
+{
+    uint32_t header[2];
+
+    if (fread(header, sizeof(header), 1, reader->file) != 1)
+    {
+        return FALSE;
+    }
+    // the writer never makes a block bigger than a batch, or packs one
+    // into more than it started with
+    if (header[0] > APEX_STREAM_BATCH || header[1] > header[0])
+    {
+        fprintf(stderr, "APEX_Error: corrupt compressed block\n");
+        exit(1);
+    }
+    grow_buffer(&reader->block, header[0]);
+    grow_buffer(&reader->packed, header[1]);
+    if (header[1] == header[0])
+    {
+        if (fread(reader->block, 1, header[0], reader->file) != header[0])
+        {
+            return FALSE;
+        }
+    }
+    else if (fread(reader->packed, 1, header[1], reader->file) != header[1] ||
+             apex_lz_decompress(reader->packed, header[1], reader->block, header[0]) != header[0])
+    {
+        fprintf(stderr, "APEX_Error: corrupt compressed block\n");
+        exit(1);
+    }
+    reader->len = header[0];
+    reader->pos = 0;
+    return TRUE;
+}
+
+/* Returns the number of bytes copied, less than n only at the end */
+size_t
+apex_trace_read(APEX_Trace_Reader *reader, void *buf, size_t n)
+{
+    size_t done = 0;
+
+    if (!reader->compressed)
+    {
+        return fread(buf, 1, n, reader->file);
+    }
+    while (done < n)
+    {
+        size_t piece;
+
+        if (reader->pos == reader->len && !next_block(reader))
+        {
+            break;
+        }
+        piece = reader->len - reader->pos < n - done ? reader->len - reader->pos : n - done;
+        memcpy((uint8_t *)buf + done, reader->block + reader->pos, piece);
+        reader->pos += piece;
+        done += piece;
+    }
+    return done;
+}
+
+/* Opens a trace file of the given kind and loads its program, leaving the
+ * reader at the first record. Reports the problem and returns FALSE if
+ * the file is not one. */
+int
+apex_trace_reader_open(APEX_Trace_Reader *reader, const char *path, uint32_t magic)
+{
+    APEX_Trace_Header header;
+    uint32_t lz_magic = 0;
+    size_t code_bytes;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (!reader->file)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open %s\n", path);
+        return FALSE;
+    }
+    if (fread(&lz_magic, sizeof(lz_magic), 1, reader->file) == 1 && lz_magic == APEX_LZ_MAGIC)
+    {
+        reader->compressed = TRUE;
+    }
+    else
+    {
+        rewind(reader->file);
+    }
+    if (apex_trace_read(reader, &header, sizeof(header)) != sizeof(header) ||
+        header.magic != magic || header.version != APEX_TRACE_VERSION)
+    {
+        fprintf(stderr, "APEX_Error: %s is not an APEX %s file\n", path,
+                magic == APEX_TRACE_MAGIC ? "event trace" : "lifetime");
+        apex_trace_reader_close(reader);
+        return FALSE;
+    }
+    reader->code_size = header.code_size;
+    reader->code = calloc(header.code_size + 1, sizeof(APEX_Trace_Insn));
+    if (!reader->code)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the program of %s\n", path);
+        apex_trace_reader_close(reader);
+        return FALSE;
+    }
+    code_bytes = header.code_size * sizeof(APEX_Trace_Insn);
+    if (apex_trace_read(reader, reader->code, code_bytes) != code_bytes)
+    {
+        fprintf(stderr, "APEX_Error: %s is truncated\n", path);
+        apex_trace_reader_close(reader);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void
+apex_trace_reader_close(APEX_Trace_Reader *reader)
+{
+    if (reader->file)
+    {
+        fclose(reader->file);
+    }
+    free(reader->block);
+    free(reader->packed);
+    free(reader->code);
+    memset(reader, 0, sizeof(*reader));
+}
+
+/* Disassembles one program entry the way the simulator prints it */
+void
+apex_trace_format_insn(const APEX_Trace_Insn *insn, char *buf, size_t size)
+{
+    const int operands[] = {0, insn->rd, insn->rs1, insn->rs2, insn->rs3, insn->imm};
+    const int *format;
+    int len;
+
+    if (insn->opcode < 0 || insn->opcode >= NUM_OPCODES)
+    {
+        snprintf(buf, size, "???");
+        return;
+    }
+    format = format_operands[OPCODE_INFO(insn->opcode)->format];
+    len = snprintf(buf, size, "%s", get_opcode_str(insn->opcode));
+    for (int i = 0; i < MAX_OPERANDS && format[i] != OPND_NONE && len < (int)size; ++i)
+    {
+        len += snprintf(buf + len, size - len, format[i] == OPND_IMM ? ",#%d" : ",R%d",
+                        operands[format[i]]);
+    }
+}
@@ -36,117 +36,53 @@ get_num_from_string(const char *buffer)
     return atoi(str);
 }
 
+/*
+ * Opcode descriptor table, indexed by numeric opcode
+ *
+ * Note : add new instructions to APEX_OPCODE_TABLE in apex_macros.h
+ */
+const APEX_Opcode_Info opcode_table[NUM_OPCODES] = {
+#define X(name, mnemonic, format, srcs, fu_class, latency, flags) \
+    [OPCODE_##name] = {mnemonic, format, srcs, fu_class, latency, flags},
+    APEX_OPCODE_TABLE(X)
+#undef X
+};
+
+/*
+ * Operand fields of every instruction format, indexed by FMT_*
+ */
+const int format_operands[NUM_FORMATS][MAX_OPERANDS] = {
+#define X(name, o1, o2, o3) [FMT_##name] = {o1, o2, o3},
+    APEX_FORMAT_TABLE(X)
+#undef X
+};
+
 /*
  * This function sets the numeric opcode to an instruction based on string value
  *
- * Note : you can edit this function to add new instructions
+ * Note : new instructions are added to APEX_OPCODE_TABLE, not here
  */
 static int
 set_opcode_str(const char *opcode_str)
 {
-    if (strcmp(opcode_str, "ADD") == 0)
-    {
-        return OPCODE_ADD;
-    }
-
-    if (strcmp(opcode_str, "ADDL") == 0)
-    {
-        return OPCODE_ADDL;
-    }
-
-    if (strcmp(opcode_str, "SUB") == 0)
-    {
-        return OPCODE_SUB;
-    }
-
-    if (strcmp(opcode_str, "SUBL") == 0)
-    {
-        return OPCODE_SUBL;
-    }
-
-    if (strcmp(opcode_str, "MUL") == 0)
-    {
-        return OPCODE_MUL;
-    }
-
-    if (strcmp(opcode_str, "DIV") == 0)
-    {
-        return OPCODE_DIV;
-    }
-
-    if (strcmp(opcode_str, "AND") == 0)
-    {
-        return OPCODE_AND;
-    }
-
-    if (strcmp(opcode_str, "OR") == 0)
-    {
-        return OPCODE_OR;
-    }
-
-    if (strcmp(opcode_str, "EXOR") == 0)
-    {
-        return OPCODE_XOR;
-    }
-
-    if (strcmp(opcode_str, "MOVC") == 0)
-    {
-        return OPCODE_MOVC;
-    }
-
-    if (strcmp(opcode_str, "LOAD") == 0)
-    {
-        return OPCODE_LOAD;
-    }
-    if (strcmp(opcode_str, "LDR") == 0)
-    {
-        return OPCODE_LDR;
-    }
-
-    if (strcmp(opcode_str, "STORE") == 0)
-    {
-        return OPCODE_STORE;
-    }
-
-    if (strcmp(opcode_str, "STR") == 0)
-    {
-        return OPCODE_STR;
-    }
-
-    if (strcmp(opcode_str, "CMP") == 0)
-    {
-        return OPCODE_CMP;
-    }
-
-    if (strcmp(opcode_str, "BZ") == 0)
-    {
-        return OPCODE_BZ;
-    }
-
-    if (strcmp(opcode_str, "BNZ") == 0)
-    {
-        return OPCODE_BNZ;
-    }
-
-    if (strcmp(opcode_str, "HALT") == 0)
+    for (int i = 0; i < NUM_OPCODES; ++i)
     {
-        return OPCODE_HALT;
-    }
-    
-    if (strcmp(opcode_str, "JAL") == 0)
-    {
-        return OPCODE_JAL;
-    }
-    
-    if (strcmp(opcode_str, "JUMP") == 0)
-    {
-        return OPCODE_JUMP;
+        if (strcmp(opcode_str, opcode_table[i].mnemonic) == 0)
+        {
+            return i;
+        }
     }
 
     assert(0 && "Invalid opcode");
     return 0;
 }
 
+const char *
+get_opcode_str(int opcode)
+{
+    return opcode_table[opcode].mnemonic;
+}
+
 static void
 split_opcode_from_insn_string(char *buffer, char tokens[2][128])
 {
@@ -162,10 +98,32 @@ split_opcode_from_insn_string(char *buffer, char tokens[2][128])
     }
 }
 
+/*
+ * Returns the field of an instruction that holds the given operand
+ */
+static int *
+get_operand_field(APEX_Instruction *ins, int operand)
+{
+    switch (operand)
+    {
+        case OPND_RD:
+            return &ins->rd;
+        case OPND_RS1:
+            return &ins->rs1;
+        case OPND_RS2:
+            return &ins->rs2;
+        case OPND_RS3:
+            return &ins->rs3;
+        case OPND_IMM:
+            return &ins->imm;
+    }
+    return NULL;
+}
+
 /*
  * This function is related to parsing input file
  *
- * Note : you can edit this function to add new instructions
+ * Note : operands are assigned from the format in APEX_OPCODE_TABLE
  */
 static void
 create_APEX_instruction(APEX_Instruction *ins, char *buffer)
@@ -173,6 +131,7 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
     int i, token_num = 0;
     char tokens[6][128];
     char top_level_tokens[2][128];
+    const APEX_Opcode_Info *info;
 
     for (i = 0; i < 2; ++i)
     {
@@ -190,84 +149,23 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
         token = strtok(NULL, ",");
     }
 
-    strcpy(ins->opcode_str, top_level_tokens[0]);
-    ins->opcode = set_opcode_str(ins->opcode_str);
-    switch (ins->opcode)
-    {
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_MUL:
-        case OPCODE_DIV:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_XOR:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
-            break;
-        }
+    ins->opcode = set_opcode_str(top_level_tokens[0]);
+    info = OPCODE_INFO(ins->opcode);
 
-        case OPCODE_MOVC:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->imm = get_num_from_string(tokens[1]);
-            break;
-        }
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        case OPCODE_LOAD:
-        case OPCODE_JAL:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
-        }
-        case OPCODE_CMP:
-        {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
-            break;
-        }
-        case OPCODE_STORE:
-        {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
-        }
-        case OPCODE_STR:
-        {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
-            ins->rs3 = get_num_from_string(tokens[2]);
-            break;
-        }
-        case OPCODE_LDR:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
-            break;
-        }
+    for (i = 0; i < MAX_OPERANDS && i < token_num; ++i)
+    {
+        int *field = get_operand_field(ins, format_operands[info->format][i]);
 
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
+        if (field)
         {
-            ins->imm = get_num_from_string(tokens[0]);
-            break;
+            *field = get_num_from_string(tokens[i]);
         }
-        
-        case OPCODE_JUMP:
-        {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->imm = get_num_from_string(tokens[1]);
-            break;
-        }
-        
     }
-    /* Fill in rest of the instructions accordingly */
+
+    /* Predecode the facts later stages need from the descriptor table */
+    ins->fu_class = info->fu_class;
+    ins->latency = info->latency;
+    ins->flags = info->flags;
 }
 
 /*
@@ -10,104 +10,466 @@
 #include <string.h>
 
 #include "apex_cpu.h"
-APEX_CPU * cpu_initialize(APEX_CPU * cpu, char const *argv[]){
-    cpu = APEX_cpu_init(argv[1]);
+#include "apex_macros.h"
+#include "apex_stats.h"
+#include "apex_stream.h"
+#include "apex_trace.h"
+
+/* --fu=class:count[:latency[:pipelined|unpipelined]] sets up one class of
+ * the FU pool, mem and jbu only take a count */
+static void
+parse_fu_option(APEX_CPU *cpu, const char *spec)
+{
+    char label[8];
+    char mode[16] = "";
+    int count = 0;
+    int latency = 0;
+    int fields = sscanf(spec, "%7[a-z]:%d:%d:%15s", label, &count, &latency, mode);
+    int fu_class = fields >= 2 ? get_fu_class(label) : FU_NONE;
+
+    if (fu_class == FU_NONE || (fields > 2 && !FU_IS_COMPUTE(fu_class)) ||
+        (fields == 4 && strcmp(mode, "pipelined") != 0 && strcmp(mode, "unpipelined") != 0))
+    {
+        fprintf(stderr, "APEX_Error: bad option --fu=%s, expected {int,mul,div}:count[:latency[:pipelined|unpipelined]] or {mem,jbu}:count\n", spec);
+        exit(1);
+    }
+    cpu->fu_config[fu_class].count = count;
+    if (fields > 2)
+    {
+        cpu->fu_config[fu_class].latency = latency;
+    }
+    if (fields > 3)
+    {
+        cpu->fu_config[fu_class].pipelined = mode[0] == 'p';
+    }
+}
+
+/* Options are the "--" arguments, they may come anywhere after the file */
+static void
+apply_options(APEX_CPU *cpu, int argc, char const *argv[])
+{
+    const char *event_trace = NULL;
+    const char *timestamps = NULL;
+    int compress = FALSE;
+    const char *bpred = APEX_BPRED_DEFAULT;
+    int bp_bits = BP_TABLE_BITS;
+    int bp_hist = BP_HIST_BITS;
+    int btb_bits = BTB_BITS;
+    int ras_depth = RAS_DEPTH;
+    int l1d_size = 0;
+    int l1d_assoc = L1D_ASSOC;
+    int l1d_line = L1D_LINE;
+    const char *l1d_repl = L1D_REPL_DEFAULT;
+    int l1d_hit = L1D_HIT_LATENCY;
+    int l1d_miss = L1D_MISS_LATENCY;
+    int mshrs = L1D_MSHRS;
+    int pf_degree = 0;
+    int pf_distance = PF_DISTANCE;
+    int pf_bits = PF_TABLE_BITS;
+    int mem_size = DATA_MEMORY_SIZE;
+    const char *mem_image = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--", 2) != 0)
+        {
+            continue;
+        }
+        if (strcmp(argv[i], "--quiet") == 0)
+        {
+            cpu->trace_level = TRACE_NONE;
+        }
+        else if (strncmp(argv[i], "--trace=", 8) == 0)
+        {
+            cpu->trace_level = atoi(argv[i] + 8);
+        }
+        else if (strcmp(argv[i], "--no-skip") == 0)
+        {
+            cpu->cycle_skip = FALSE;
+        }
+        else if (strncmp(argv[i], "--event-trace=", 14) == 0)
+        {
+            event_trace = argv[i] + 14;
+        }
+        else if (strncmp(argv[i], "--timestamps=", 13) == 0)
+        {
+            timestamps = argv[i] + 13;
+        }
+        else if (strcmp(argv[i], "--trace-lz") == 0)
+        {
+            compress = TRUE;
+        }
+        else if (strncmp(argv[i], "--profile=", 10) == 0)
+        {
+            cpu->profile_file = argv[i] + 10;
+        }
+        else if (strncmp(argv[i], "--stats=", 8) == 0)
+        {
+            cpu->stats_file = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "--bpred=", 8) == 0)
+        {
+            bpred = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "--bp-bits=", 10) == 0)
+        {
+            bp_bits = atoi(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--bp-hist=", 10) == 0)
+        {
+            bp_hist = atoi(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--btb-bits=", 11) == 0)
+        {
+            btb_bits = atoi(argv[i] + 11);
+        }
+        else if (strncmp(argv[i], "--ras-depth=", 12) == 0)
+        {
+            ras_depth = atoi(argv[i] + 12);
+        }
+        else if (strncmp(argv[i], "--l1d=", 6) == 0)
+        {
+            if (sscanf(argv[i] + 6, "%d:%d:%d", &l1d_size, &l1d_assoc, &l1d_line) < 1)
+            {
+                fprintf(stderr, "APEX_Error: bad option %s, expected --l1d=size[:assoc[:line]]\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "--l1d-repl=", 11) == 0)
+        {
+            l1d_repl = argv[i] + 11;
+        }
+        else if (strncmp(argv[i], "--l1d-latency=", 14) == 0)
+        {
+            if (sscanf(argv[i] + 14, "%d:%d", &l1d_hit, &l1d_miss) != 2)
+            {
+                fprintf(stderr, "APEX_Error: bad option %s, expected --l1d-latency=hit:miss\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "--mshrs=", 8) == 0)
+        {
+            mshrs = atoi(argv[i] + 8);
+        }
+        else if (strncmp(argv[i], "--prefetch=", 11) == 0)
+        {
+            if (sscanf(argv[i] + 11, "%d:%d", &pf_degree, &pf_distance) < 1)
+            {
+                fprintf(stderr, "APEX_Error: bad option %s, expected --prefetch=degree[:distance]\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "--pf-bits=", 10) == 0)
+        {
+            pf_bits = atoi(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--mem-size=", 11) == 0)
+        {
+            mem_size = atoi(argv[i] + 11);
+        }
+        else if (strncmp(argv[i], "--mem-image=", 12) == 0)
+        {
+            mem_image = argv[i] + 12;
+        }
+        else if (strncmp(argv[i], "--mem-dump=", 11) == 0)
+        {
+            cpu->mem_dump_file = argv[i] + 11;
+        }
+        else if (strncmp(argv[i], "--width=", 8) == 0)
+        {
+            cpu->fetch_width = cpu->dispatch_width = cpu->commit_width = atoi(argv[i] + 8);
+        }
+        else if (strncmp(argv[i], "--fetch-width=", 14) == 0)
+        {
+            cpu->fetch_width = atoi(argv[i] + 14);
+        }
+        else if (strncmp(argv[i], "--dispatch-width=", 17) == 0)
+        {
+            cpu->dispatch_width = atoi(argv[i] + 17);
+        }
+        else if (strncmp(argv[i], "--commit-width=", 15) == 0)
+        {
+            cpu->commit_width = atoi(argv[i] + 15);
+        }
+        else if (strncmp(argv[i], "--select=", 9) == 0)
+        {
+            cpu->select_policy = get_select_policy(argv[i] + 9);
+            if (cpu->select_policy < 0)
+            {
+                fprintf(stderr, "APEX_Error: unknown select policy %s\n", argv[i] + 9);
+                exit(1);
+            }
+            cpu->stats.select_policy = get_select_policy_str(cpu->select_policy);
+        }
+        else if (strncmp(argv[i], "--fu=", 5) == 0)
+        {
+            parse_fu_option(cpu, argv[i] + 5);
+        }
+        else if (strcmp(argv[i], "--sync-out") == 0)
+        {
+            // handled by main before the CPU exists
+        }
+        else
+        {
+            fprintf(stderr, "APEX_Error: unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (cpu->fetch_width < 1 || cpu->fetch_width > MAX_WIDTH || cpu->dispatch_width < 1 ||
+        cpu->dispatch_width > MAX_WIDTH || cpu->commit_width < 1 || cpu->commit_width > MAX_WIDTH)
+    {
+        fprintf(stderr, "APEX_Error: widths must be 1 to %d\n", MAX_WIDTH);
+        exit(1);
+    }
+    if (!build_function_units(cpu))
+    {
+        fprintf(stderr, "APEX_Error: the FU pool takes 1 to %d units in all, at least one of each class, latencies 1 to %d\n",
+                MAX_FUS, MAX_FU_LATENCY);
+        exit(1);
+    }
+    apex_bpred_free(cpu->bpred);
+    cpu->bpred = apex_bpred_create(bpred, bp_bits, bp_hist, btb_bits, ras_depth);
+    if (!cpu->bpred)
+    {
+        fprintf(stderr,
+                "APEX_Error: bad branch predictor %s, bits %d, history %d, BTB bits %d, RAS depth %d\n",
+                bpred, bp_bits, bp_hist, btb_bits, ras_depth);
+        exit(1);
+    }
+    cpu->stats.predictor = cpu->bpred->name;
+    apex_mem_free(cpu->data_memory);
+    cpu->data_memory = apex_mem_create(mem_size);
+    if (!cpu->data_memory)
+    {
+        fprintf(stderr, "APEX_Error: bad data memory size %d\n", mem_size);
+        exit(1);
+    }
+    if (mem_image)
+    {
+        // --mem-image=file[@base], the image goes at word base
+        char path[strlen(mem_image) + 1];
+        char *at;
+        int base = 0;
+
+        strcpy(path, mem_image);
+        at = strrchr(path, '@');
+        if (at)
+        {
+            *at = '\0';
+            base = atoi(at + 1);
+        }
+        if (apex_mem_load(cpu->data_memory, path, base) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to load data memory image %s at %d, or it does not fit in %d words\n",
+                    path, base, mem_size);
+            exit(1);
+        }
+    }
+    if (l1d_size)
+    {
+        cpu->l1d = apex_cache_create(l1d_size, l1d_assoc, l1d_line, l1d_repl, l1d_hit, l1d_miss, mshrs);
+        if (!cpu->l1d)
+        {
+            fprintf(stderr,
+                    "APEX_Error: bad L1D of %d words, %d-way, %d-word lines, %s, latencies %d/%d, %d MSHRs\n",
+                    l1d_size, l1d_assoc, l1d_line, l1d_repl, l1d_hit, l1d_miss, mshrs);
+            exit(1);
+        }
+        cpu->stats.l1d = cpu->l1d->name;
+    }
+    if (pf_degree)
+    {
+        // memory without an L1D already answers in a cycle, there is nothing to hide
+        if (!cpu->l1d)
+        {
+            fprintf(stderr, "APEX_Error: --prefetch needs an L1D to fill, add --l1d\n");
+            exit(1);
+        }
+        cpu->prefetcher = apex_prefetch_create(pf_degree, pf_distance, pf_bits);
+        if (!cpu->prefetcher)
+        {
+            fprintf(stderr, "APEX_Error: bad prefetcher of degree %d, distance %d, %d table bits\n",
+                    pf_degree, pf_distance, pf_bits);
+            exit(1);
+        }
+        cpu->stats.prefetcher = cpu->prefetcher->name;
+    }
+    if (event_trace)
+    {
+        cpu->event_trace = apex_trace_open(event_trace, APEX_TRACE_MAGIC, cpu->code_memory,
+                                           cpu->code_memory_size, compress);
+        if (!cpu->event_trace)
+        {
+            fprintf(stderr, "APEX_Error: Unable to create event trace %s\n", event_trace);
+            exit(1);
+        }
+    }
+    if (timestamps)
+    {
+        cpu->lifetimes = apex_trace_open(timestamps, APEX_LIFETIME_MAGIC, cpu->code_memory,
+                                         cpu->code_memory_size, compress);
+        if (!cpu->lifetimes)
+        {
+            fprintf(stderr, "APEX_Error: Unable to create timestamps file %s\n", timestamps);
+            exit(1);
+        }
+    }
+}
+
+/* Pushes out whatever is still queued for stdout, also on exit(1) */
+static void
+close_output(void)
+{
+    apex_stream_close(apex_out);
+    apex_out = NULL;
+}
+
+APEX_CPU * cpu_initialize(APEX_CPU * cpu, const char *filename, int argc, char const *argv[]){
+    cpu = APEX_cpu_init(filename);
     if (!cpu)
     {
         fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
         exit(1);
     }
+    apply_options(cpu, argc, argv);
+    print_code_memory(cpu);
     return cpu;
 }
 static void
 print_reg_file(const APEX_CPU *cpu)
 {
-    printf("----------------------------------------\n%s\n----------------------------------------\n", "State of Architectural Registers");
+    apex_printf("----------------------------------------\n%s\n----------------------------------------\n", "State of Architectural Registers");
     char r[] = "| Registers |";
     char v[] = "Value |";
     char s[] = "Status |";
-    printf("%-7s %7s %7s\n",r,s,v);
-    for (int i = 0; i < REG_FILE_SIZE; ++i)
+    apex_printf("%-7s %7s %7s\n",r,s,v);
+    for (int i = 0; i < R_TABLE_SIZE; ++i)
     {
-         
-        printf("    REG %-7d%-8s[%-3d]\n", i,cpu->regs[i].status == 1 ? "VALID" : "INVALID",cpu->regs[i].value);
+        /* committed state lives in the register the backend table points at */
+        const REG_FILE *reg = &cpu->regs[cpu->back_end_table[i]];
+        apex_printf("    REG %-7d%-8s[%-3d]\n", i,reg->status == 1 ? "VALID" : "INVALID",reg->value);
     }
 
-    printf("\n");
+    apex_printf("\n");
+}
+
+/* Counters go in the final report, to --stats={file} as JSON and, per
+ * line of the program, to --profile={file}; data memory goes to
+ * --mem-dump={file} */
+static void
+report_stats(const APEX_CPU *cpu, const char *source)
+{
+    apex_stats_print(&cpu->stats);
+    if (cpu->stats_file && apex_stats_dump(&cpu->stats, cpu->stats_file) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write stats to %s\n", cpu->stats_file);
+    }
+    if (cpu->profile_file && apex_profile_write(cpu, source, cpu->profile_file) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write profile to %s\n", cpu->profile_file);
+    }
+    if (cpu->mem_dump_file && apex_mem_dump(cpu->data_memory, cpu->mem_dump_file) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write data memory to %s\n", cpu->mem_dump_file);
+    }
 }
 
 static void
 print_data_mem(const APEX_CPU *cpu)
 {
-    printf("----------------------------------------\n%s\n----------------------------------------\n", " STATE OF DATA MEMORY");
+    apex_printf("----------------------------------------\n%s\n----------------------------------------\n", " STATE OF DATA MEMORY");
     
     for (int i = 0; i < 10; ++i)
     {
          
-        printf("   MEM%-11d \t\t Data Value = %d\n", i,cpu->data_memory[i]);
+        apex_printf("   MEM%-11d \t\t Data Value = %d\n", i, apex_mem_read(cpu->data_memory, i));
     }
 
-    printf("\n");
+    apex_printf("\n");
 }
 int main(int argc, char const *argv[])
 {
     APEX_CPU *cpu = NULL;
+    char const *args[argc + 1];
+    int nargs = 0;
+    int sync_out = FALSE;
+
+    /* Mode arguments are positional, options are picked up by apply_options */
+    for (int i = 0; i < argc; i++)
+    {
+        if (i == 0 || strncmp(argv[i], "--", 2) != 0)
+        {
+            args[nargs++] = argv[i];
+        }
+        sync_out |= strcmp(argv[i], "--sync-out") == 0;
+    }
+    args[nargs] = NULL;
+
+    /* stdout is written by a background thread unless --sync-out is given */
+    if (!sync_out)
+    {
+        apex_out = apex_stream_open(stdout, "stdout", FALSE);
+        atexit(close_output);
+    }
     
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
 
-    if (!argv[1])
+    if (!args[1])
     {
         fprintf(stderr, "APEX_Help: Usage make file={input_file} initialize\n");
         fprintf(stderr, "APEX_Help: Usage make file={input_file} simulate cycles={no. of cyles}\n");
         fprintf(stderr, "APEX_Help: Usage make file={input_file} display cycles={no. of cyles} showMem={Data memory address (optional)}\n");
+        fprintf(stderr, "APEX_Help: Options opts=\"--quiet --trace={0,1,2} --no-skip --event-trace={file} --timestamps={file} --trace-lz --stats={file} --profile={file} --bpred={static,bimodal,gshare,tage} --bp-bits=n --bp-hist=n --btb-bits=n --ras-depth=n --width=n --fetch-width=n --dispatch-width=n --commit-width=n --fu=class:count[:latency[:pipelined|unpipelined]] --select={position,oldest,random} --l1d=size[:assoc[:line]] --l1d-repl={lru,plru,random} --l1d-latency=hit:miss --mshrs=n --prefetch=degree[:distance] --pf-bits=n --mem-size=n --mem-image={file}[@base] --mem-dump={file} --sync-out\"\n");
         exit(1);
     }
-    if(strcmp(argv[2],"initialize") == 0){
-        cpu = cpu_initialize(cpu,argv);
+    if(strcmp(args[2],"initialize") == 0){
+        cpu = cpu_initialize(cpu,args[1],argc,argv);
     }
-    if(strcmp(argv[2],"simulate") == 0){
-        if(argc != 4){
+    if(strcmp(args[2],"simulate") == 0){
+        if(nargs != 4){
             fprintf(stderr, "APEX_Help: Usage make file={input_file} simulate cycles={no. of cyles}\n");
             exit(1);
         }
-        if (!cpu) cpu = cpu_initialize(cpu,argv);
+        if (!cpu) cpu = cpu_initialize(cpu,args[1],argc,argv);
         cpu->simulation_enabled = TRUE;
-        cpu->simulation_cycles = atoi(argv[3]);
+        cpu->simulation_cycles = atoi(args[3]);
         APEX_cpu_run(cpu);
         print_reg_file(cpu);
         print_data_mem(cpu);
+        report_stats(cpu, args[1]);
     }
-    if(strcmp(argv[2],"single_step") == 0){
-        if(argc != 3){
+    if(strcmp(args[2],"single_step") == 0){
+        if(nargs != 3){
             fprintf(stderr, "APEX_Help: Usage make file={input_file} single_step\n");
             exit(1);
         }
-        if (!cpu) cpu = cpu_initialize(cpu,argv);
+        if (!cpu) cpu = cpu_initialize(cpu,args[1],argc,argv);
         cpu->single_step = ENABLE_DEBUG_MESSAGES;
         APEX_cpu_run(cpu);
     }
-    if(strcmp(argv[2],"display") == 0){
-        if(!argv[3]){
+    if(strcmp(args[2],"display") == 0){
+        if(!args[3]){
             fprintf(stderr, "APEX_Help: Usage make file={input_file} display cycles={no. of cyles} showMem={Data memory address (optional)}\n");
             exit(1);
         }
-        if (!cpu) cpu = cpu_initialize(cpu,argv);
-        cpu->simulation_cycles = atoi(argv[3]);
+        if (!cpu) cpu = cpu_initialize(cpu,args[1],argc,argv);
+        cpu->simulation_cycles = atoi(args[3]);
         cpu->simulation_enabled = FALSE;
         APEX_cpu_run(cpu);
         print_reg_file(cpu);
         print_data_mem(cpu);
-        printf("---- Flag Register ----\n");
-        printf("\t Zero Flag = %d \n",cpu->zero_flag.value);
-        if(argv[4]){
-            char addresses[strlen(argv[4])+1];
-            strcpy(addresses,argv[4]);
+        report_stats(cpu, args[1]);
+        apex_printf("---- Flag Register ----\n");
+        apex_printf("\t Zero Flag = %d \n",cpu->zero_flag.value);
+        if(args[4]){
+            char addresses[strlen(args[4])+1];
+            strcpy(addresses,args[4]);
             char *add;
             add=strtok(addresses, ",");
             while(add) 
             { 
-                if(atoi(add)){
-                    printf("---- Data Memory [%s] => %d ----\n",add, cpu->data_memory[atoi(add)]);
+                if(atoi(add) && apex_mem_valid(cpu->data_memory, atoi(add))){
+                    apex_printf("---- Data Memory [%s] => %d ----\n",add, apex_mem_read(cpu->data_memory, atoi(add)));
                 }else{
                     fprintf(stderr, "APEX_Error:  add valid numbers\n");
                     exit(1);